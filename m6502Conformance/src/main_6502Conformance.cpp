@@ -0,0 +1,218 @@
+﻿#include "6502SingleStep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+using namespace m6502;
+
+static const char* USAGE = R"(usage: m6502Conformance [options] corpus...
+
+Runs single step conformance corpora: one JSON file of cases per opcode, as in the ProcessorTests 6502 and 65x02
+sets. A corpus is a file or a directory of .json files. The corpora are large and aren't part of the repository,
+vendor them locally and point the runner at them.
+
+  --cpu CPU            6502 (default), 6502-undoc or 65c02
+  -j, --jobs N         worker threads (default: all cores)
+  --max-failures N     failures to print per file (default 5)
+  -q, --quiet          only print files with failures and the summary
+
+exit status: 0 if every case passed, 1 if any failed, 2 on usage or read errors
+)";
+
+namespace
+{
+    struct FileResult
+    {
+        size_t cases = 0;
+        size_t failures = 0;
+        std::vector<std::string> firstFailures;
+        std::string error;
+    };
+
+    template <typename CPUType>
+    FileResult run_file(const std::filesystem::path& path, size_t maxFailures)
+    {
+        FileResult result;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            result.error = "cannot open";
+            return result;
+        }
+
+        // every case only touches a few bytes and puts them back, so one zeroed Mem does for the whole file
+        auto memory = std::make_unique<Mem>();
+        CPUType cpu;
+        cpu.reset(*memory);
+        SingleStepReader reader(file);
+        SingleStepCase testCase;
+        try
+        {
+            while (reader.next(testCase))
+            {
+                result.cases++;
+                std::string mismatches = run_single_step(testCase, cpu, *memory);
+                if (!mismatches.empty())
+                {
+                    result.failures++;
+                    if (result.firstFailures.size() < maxFailures)
+                    {
+                        result.firstFailures.push_back(testCase.name + ": " + mismatches);
+                    }
+                }
+            }
+        }
+        catch (const std::exception& error)
+        {
+            result.error = error.what();
+        }
+        return result;
+    }
+}
+
+static int usage_error(const std::string& message)
+{
+    fprintf(stderr, "m6502Conformance: %s\n\n%s", message.c_str(), USAGE);
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    std::string cpu = "6502";
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxFailures = 5;
+    bool quiet = false;
+    std::vector<std::filesystem::path> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printf("%s", USAGE);
+            return 0;
+        }
+        else if (arg == "-q" || arg == "--quiet")
+        {
+            quiet = true;
+        }
+        else if (arg == "--cpu" || arg == "-j" || arg == "--jobs" || arg == "--max-failures")
+        {
+            if (i + 1 == argc)
+            {
+                return usage_error(arg + " needs a value");
+            }
+            std::string value = argv[++i];
+            if (arg == "--cpu")
+            {
+                if (value != "6502" && value != "6502-undoc" && value != "65c02")
+                {
+                    return usage_error("unknown cpu " + value);
+                }
+                cpu = value;
+            }
+            else if (arg == "--max-failures")
+            {
+                maxFailures = std::max(0, atoi(value.c_str()));
+            }
+            else
+            {
+                threadCount = std::max(1, atoi(value.c_str()));
+            }
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            return usage_error("unknown option " + arg);
+        }
+        else
+        {
+            std::error_code error;
+            if (std::filesystem::is_directory(arg, error))
+            {
+                std::vector<std::filesystem::path> corpus;
+                for (const auto& entry : std::filesystem::directory_iterator(arg, error))
+                {
+                    if (entry.is_regular_file() && entry.path().extension() == ".json")
+                    {
+                        corpus.push_back(entry.path());
+                    }
+                }
+                std::sort(corpus.begin(), corpus.end());
+                files.insert(files.end(), corpus.begin(), corpus.end());
+            }
+            else
+            {
+                files.push_back(arg);
+            }
+        }
+    }
+    if (files.empty())
+    {
+        return usage_error("no corpus files");
+    }
+
+    auto run = cpu == "65c02" ? run_file<CPU65C02> : cpu == "6502-undoc" ? run_file<CPUIllegal> : run_file<CPU>;
+
+    // a file per opcode is plenty of work per task, workers take the next file until there are none left
+    std::vector<FileResult> results(files.size());
+    std::atomic<size_t> nextFile = 0;
+    threadCount = std::min(threadCount, files.size());
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        workers.emplace_back([&]() {
+            for (size_t file = nextFile++; file < files.size(); file = nextFile++)
+            {
+                results[file] = run(files[file], maxFailures);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int status = 0;
+    size_t totalCases = 0, totalFailures = 0, failedFiles = 0;
+    for (size_t file = 0; file < files.size(); file++)
+    {
+        const FileResult& result = results[file];
+        totalCases += result.cases;
+        totalFailures += result.failures;
+        const std::string name = files[file].filename().string();
+        if (!result.error.empty())
+        {
+            printf("%s: error: %s\n", name.c_str(), result.error.c_str());
+            status = 2;
+            continue;
+        }
+        if (result.failures > 0)
+        {
+            failedFiles++;
+            status = std::max(status, 1);
+        }
+        else if (quiet)
+        {
+            continue;
+        }
+
+        printf("%s: %zu/%zu passed\n", name.c_str(), result.cases - result.failures, result.cases);
+        for (const std::string& failure : result.firstFailures)
+        {
+            printf("    %s\n", failure.c_str());
+        }
+    }
+
+    printf("files:   %zu, %zu with failures, on %zu threads\n", files.size(), failedFiles, threadCount);
+    printf("cases:   %zu, %zu failed\n", totalCases, totalFailures);
+    printf("time:    %.3f s, %.0f cases/s\n", seconds, seconds > 0 ? totalCases / seconds : 0.0);
+    return status;
+}
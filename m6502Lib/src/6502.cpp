@@ -1,153 +1,937 @@
 ﻿#include "6502.h"
+#include "6502Replay.h"
 
+namespace
+{
+    // static_assert in a discarded if constexpr branch has to depend on a template parameter
+    template <auto>
+    constexpr bool always_false = false;
+}
 
-int32_t m6502::CPU::execute(int32_t cycles, Mem& memory)
+template <typename Variant>
+int32_t m6502::BasicCPU<Variant>::execute(int32_t cycles, Mem& memory)
 {
-    const int32_t cyclesRequested = cycles;
+    if (fusionStats)
+    {
+        return execute_with_stats(cycles, memory);
+    }
+
+    const auto& handlers = fusionEnabled ? fusedInstructionTable : instructionTable;
+    const uint64_t cycleStart = cycleCount;
+    cycleEnd = cycleCount + cycles;
+    uint64_t retired = 0; // the fused handlers count the instructions they add
     while (cycles > 0)
     {
         uint8_t opCode = fetch_byte(cycles, memory);
-        auto handler = instructionTable[opCode];
-        handler(cycles, memory);
+        auto handler = handlers[opCode];
+        handler(*this, cycles, memory);
+        retired++;
     }
 
-    return cyclesRequested - cycles; // number of cycles used
+    instructionCount += retired;
+    cycleCount = cycleEnd - cycles;
+    return static_cast<int32_t>(cycleCount - cycleStart); // number of cycles used
 }
 
-void m6502::CPU::initialize_instruction_table()
+template <typename Variant>
+int32_t m6502::BasicCPU<Variant>::execute_with_stats(int32_t cycles, Mem& memory)
 {
-    // No operation. NOP takes 2 cycles, one for getting the opcode and one for the instruction itself.
-    auto NOP_lambda = [](int32_t& cycles, Mem& memory) { cycles--; };
+    const auto& handlers = fusionEnabled ? fusedInstructionTable : instructionTable;
+    const uint64_t cycleStart = cycleCount;
+    cycleEnd = cycleCount + cycles;
+    uint32_t previousOpCode = UINT32_MAX; // no pair for the first instruction
+    while (cycles > 0)
+    {
+        uint8_t opCode = fetch_byte(cycles, memory);
+        if (previousOpCode != UINT32_MAX)
+        {
+            fusionStats->dispatchedPairs[previousOpCode << 8 | opCode]++;
+        }
+        auto handler = handlers[opCode];
+        const uint64_t countBefore = instructionCount;
+        handler(*this, cycles, memory);
+        // a fused handler counts each instruction it runs after opCode, the last of those is the one that ran last
+        const uint64_t fusedSteps = instructionCount - countBefore;
+        previousOpCode = fusedSteps == 0 ? opCode : FUSION_PATTERNS[fusion_pattern_for(opCode)].opcodes[fusedSteps];
+        instructionCount++;
+    }
+
+    cycleCount = cycleEnd - cycles;
+    return static_cast<int32_t>(cycleCount - cycleStart);
+}
 
-    for (auto& entry : instructionTable)
+template <typename Variant>
+bool m6502::BasicCPU<Variant>::irq(Mem& memory)
+{
+    if (stopped)
+    {
+        return false;
+    }
+    if (I)
     {
-        entry = NOP_lambda;
+        // a masked IRQ still ends a WAI, execution carries on after it
+        if (waiting)
+        {
+            PC++;
+            waiting = false;
+        }
+        return false;
     }
+    interrupt(0xFFFE, memory);
+    return true;
+}
 
-    // shared handlers may be better for maintainability. not using them for now
-    
-    /** LDA family */
-    // ----------------------
-    instructionTable[INS_LDA_IM] = [&](int32_t& cycles, Mem& memory) {
-        A = fetch_byte(cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_ZP] = [&](int32_t& cycles, Mem& memory) {
-        uint8_t ZeroPageAddress = AddrZeroPage(cycles, memory);
-        A = peek_byte(ZeroPageAddress, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_ZPX] = [&](int32_t& cycles, Mem& memory) {
-        uint8_t ZeroPageAddress = AddrZeroPage(cycles, memory);
-        ZeroPageAddress = wrap_zero_page(ZeroPageAddress + X);
-        cycles--; // adding X to teh ZPA takes a cycle
-        A = peek_byte(ZeroPageAddress, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_ABS] = [&](int32_t& cycles, Mem& memory) {
-        uint16_t addr = fetch_word(cycles, memory);
-        A = peek_byte(addr, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_ABSX] = [&](int32_t& cycles, Mem& memory) {
-        uint16_t baseAddr = fetch_word(cycles, memory);
-        uint16_t effectiveAddr = baseAddr + X;
-        if (crosses_page_boundary(effectiveAddr, baseAddr))
+template <typename Variant>
+void m6502::BasicCPU<Variant>::nmi(Mem& memory)
+{
+    if (stopped)
+    {
+        return;
+    }
+    interrupt(0xFFFA, memory);
+}
+
+template <typename Variant>
+void m6502::BasicCPU<Variant>::interrupt(uint16_t vector, Mem& memory)
+{
+    if (waiting)
+    {
+        PC++; // return past the WAI
+        waiting = false;
+    }
+    int32_t cycles = 0;
+    cycleEnd = cycleCount; // so writes to output pages are stamped with the right cycle
+    cycles -= 2; // two internal cycles before the pushes
+    push_byte(PC >> 8, cycles, memory);
+    push_byte(PC & 0xFF, cycles, memory);
+    push_byte(get_status(false), cycles, memory);
+    I = 1;
+    if constexpr (Variant::cmos)
+    {
+        D = 0;
+    }
+    PC = peek_word(vector, cycles, memory);
+    cycleCount -= cycles;
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::read_input(uint16_t address, int32_t cycles)
+{
+    return inputSource->read(address, cycleEnd - cycles);
+}
+
+template <typename Variant>
+void m6502::BasicCPU<Variant>::write_output(uint16_t address, uint8_t value, int32_t& cycles)
+{
+    if (outputSink->write(address, value, cycleEnd - cycles) && cycles > 0)
+    {
+        // move the end of the budget here. the instruction still finishes, and cycleCount still adds up
+        cycleEnd -= cycles;
+        cycles = 0;
+    }
+}
+
+template <typename Variant>
+template <size_t Pattern, size_t Step>
+void m6502::BasicCPU<Variant>::continue_fusion(int32_t& cycles, Mem& memory)
+{
+    constexpr FusionPattern pattern = FUSION_PATTERNS[Pattern];
+    if constexpr (Step < pattern.length)
+    {
+        constexpr uint8_t nextOpCode = pattern.opcodes[Step];
+        // execute() would stop here once the budget is used up
+        if (cycles > 0 && memory[PC] == nextOpCode)
         {
-            cycles--;
+            fetch_byte(cycles, memory);
+            execute_opcode<nextOpCode>(cycles, memory);
+            instructionCount++;
+            continue_fusion<Pattern, Step + 1>(cycles, memory);
         }
-        A = peek_byte(effectiveAddr, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_ABSY] = [&](int32_t& cycles, Mem& memory) {
-        uint16_t baseAddr = fetch_word(cycles, memory);
-        uint16_t effectiveAddr = baseAddr + Y;
-        if (crosses_page_boundary(effectiveAddr, baseAddr))
+    }
+    else if (fusionStats)
+    {
+        fusionStats->fired[Pattern]++;
+    }
+}
+
+template <typename Variant>
+template <size_t... Opcodes>
+constexpr std::array<typename m6502::BasicCPU<Variant>::InstructionHandler, 256>
+m6502::BasicCPU<Variant>::make_instruction_table(std::index_sequence<Opcodes...>)
+{
+    return {&BasicCPU::dispatch<static_cast<uint8_t>(Opcodes)>...};
+}
+
+template <typename Variant>
+template <size_t... Opcodes>
+constexpr std::array<typename m6502::BasicCPU<Variant>::InstructionHandler, 256>
+m6502::BasicCPU<Variant>::make_fused_instruction_table(std::index_sequence<Opcodes...>)
+{
+    auto handler = []<size_t Opcode>() -> InstructionHandler {
+        constexpr size_t pattern = fusion_pattern_for(Opcode);
+        if constexpr (pattern == NO_FUSION)
         {
-            cycles--;
+            return &BasicCPU::dispatch<Opcode>;
         }
-        A = peek_byte(effectiveAddr, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_INDX] = [&](int32_t& cycles, Mem& memory) {
-        uint8_t zpAddr = AddrZeroPageX(cycles, memory);
-        uint16_t effectiveAddr = peek_word(zpAddr, cycles, memory);
-        A = peek_byte(effectiveAddr, cycles, memory);
-        zn_set_status(A);
-    };
-    instructionTable[INS_LDA_INDY] = [&](int32_t& cycles, Mem& memory) {
-        uint8_t zpAddr = fetch_byte(cycles, memory);
-        uint16_t baseAddr = peek_word(zpAddr, cycles, memory);
-        uint16_t effectiveAddr = baseAddr + Y;
-        if (crosses_page_boundary(effectiveAddr, baseAddr))
+        else
         {
-            cycles--;
+            return &BasicCPU::dispatch_fused<Opcode, pattern>;
         }
-        A = peek_byte(effectiveAddr, cycles, memory);
-        zn_set_status(A);
     };
-    // ---------------------------------------------
-    
-    /** LDX Family */
-    // ------------------
-    instructionTable[INS_LDX_IM] = [&](int32_t& cycles, Mem& memory)
+    return {handler.template operator()<Opcodes>()...};
+}
+
+template <typename Variant>
+const std::array<typename m6502::BasicCPU<Variant>::InstructionHandler, 256> m6502::BasicCPU<Variant>::instructionTable =
+    make_instruction_table(std::make_index_sequence<256>{});
+
+template <typename Variant>
+const std::array<typename m6502::BasicCPU<Variant>::InstructionHandler, 256> m6502::BasicCPU<Variant>::fusedInstructionTable =
+    make_fused_instruction_table(std::make_index_sequence<256>{});
+
+template <typename Variant>
+template <uint8_t Opcode>
+void m6502::BasicCPU<Variant>::execute_opcode(int32_t& cycles, Mem& memory)
+{
+    using enum Mnemonic;
+    constexpr OpInfo info = Variant::opcodes[Opcode];
+    constexpr Mnemonic ins = info.mnemonic;
+    constexpr AddrMode mode = info.mode;
+    // the 65C02 only pays the index cycle of ASL/LSR/ROL/ROR abs,X on a page crossing
+    constexpr Access shiftAccess = Variant::cmos ? Access::Read : Access::Modify;
+
+    /** Load / store */
+    // ----------------------
+    if constexpr (ins == LDA)
     {
-        X = fetch_byte(cycles, memory);
-        zn_set_status(X);
-    };
-    instructionTable[INS_LDX_ZP] = [&](int32_t& cycles, Mem& memory)
+        A = read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+    }
+    else if constexpr (ins == LDX)
     {
-        uint8_t ZeroPageAddress = AddrZeroPage(cycles, memory);
-        X = peek_byte(ZeroPageAddress, cycles, memory);
+        X = read_operand<mode>(cycles, memory);
         zn_set_status(X);
-    };
-    // -------------------
+    }
+    else if constexpr (ins == LDY)
+    {
+        Y = read_operand<mode>(cycles, memory);
+        zn_set_status(Y);
+    }
+    else if constexpr (ins == STA)
+    {
+        write_operand<mode>(A, cycles, memory);
+    }
+    else if constexpr (ins == STX)
+    {
+        write_operand<mode>(X, cycles, memory);
+    }
+    else if constexpr (ins == STY)
+    {
+        write_operand<mode>(Y, cycles, memory);
+    }
+    else if constexpr (ins == STZ)
+    {
+        write_operand<mode>(0, cycles, memory);
+    }
+    // ----------------------
 
-    /** LDY Family */
+    /** Register transfers */
     // ----------------------
-    instructionTable[INS_LDY_IM] = [&](int32_t& cycles, Mem& memory)
+    else if constexpr (ins == TAX)
     {
-        Y = fetch_byte(cycles, memory);
-        zn_set_status(Y);
-    };
-    instructionTable[INS_LDY_ZP] = [&](int32_t& cycles, Mem& memory)
+        cycles--;
+        X = A;
+        zn_set_status(X);
+    }
+    else if constexpr (ins == TAY)
     {
-        uint8_t ZeroPageAddress = AddrZeroPage(cycles, memory);
-        Y = peek_byte(ZeroPageAddress, cycles, memory);
+        cycles--;
+        Y = A;
         zn_set_status(Y);
-    };
-    instructionTable[INS_LDY_ZPX] = [&](int32_t& cycles, Mem& memory)
+    }
+    else if constexpr (ins == TXA)
     {
-        uint8_t ZeroPageAddress = AddrZeroPageX(cycles, memory);
-        Y = peek_byte(ZeroPageAddress, cycles, memory);
-        zn_set_status(Y);
-    };
+        cycles--;
+        A = X;
+        zn_set_status(A);
+    }
+    else if constexpr (ins == TYA)
+    {
+        cycles--;
+        A = Y;
+        zn_set_status(A);
+    }
+    else if constexpr (ins == TSX)
+    {
+        cycles--;
+        X = SP;
+        zn_set_status(X);
+    }
+    else if constexpr (ins == TXS)
+    {
+        cycles--;
+        SP = X; // no flags
+    }
+    // ----------------------
+
+    /** Stack operations */
+    // ----------------------
+    else if constexpr (ins == PHA || ins == PHX || ins == PHY || ins == PHP)
+    {
+        cycles--; // dummy read of the next byte
+        uint8_t value = ins == PHA ? A : ins == PHX ? X : ins == PHY ? Y : get_status(true);
+        push_byte(value, cycles, memory);
+    }
+    else if constexpr (ins == PLA || ins == PLX || ins == PLY)
+    {
+        cycles -= 2; // dummy read of the next byte, then the stack pointer increment
+        uint8_t& reg = ins == PLA ? A : ins == PLX ? X : Y;
+        reg = pull_byte(cycles, memory);
+        zn_set_status(reg);
+    }
+    else if constexpr (ins == PLP)
+    {
+        cycles -= 2;
+        set_status(pull_byte(cycles, memory));
+    }
+    // ----------------------
+
+    /** Logical */
+    // ----------------------
+    else if constexpr (ins == AND)
+    {
+        A &= read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+    }
+    else if constexpr (ins == EOR)
+    {
+        A ^= read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+    }
+    else if constexpr (ins == ORA)
+    {
+        A |= read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+    }
+    else if constexpr (ins == BIT)
+    {
+        uint8_t value = read_operand<mode>(cycles, memory);
+        Z = (A & value) == 0;
+        if constexpr (mode != AddrMode::Immediate) // 65C02 BIT #imm only touches Z
+        {
+            N = (value & 0x80) != 0;
+            V = (value & 0x40) != 0;
+        }
+    }
+    // ----------------------
+
+    /** Arithmetic */
+    // ----------------------
+    else if constexpr (ins == ADC)
+    {
+        adc(read_operand<mode>(cycles, memory), cycles);
+    }
+    else if constexpr (ins == SBC)
+    {
+        sbc(read_operand<mode>(cycles, memory), cycles);
+    }
+    else if constexpr (ins == CMP)
+    {
+        compare(A, read_operand<mode>(cycles, memory));
+    }
+    else if constexpr (ins == CPX)
+    {
+        compare(X, read_operand<mode>(cycles, memory));
+    }
+    else if constexpr (ins == CPY)
+    {
+        compare(Y, read_operand<mode>(cycles, memory));
+    }
+    // ----------------------
+
+    /** Increments and decrements */
+    // ----------------------
+    else if constexpr (ins == INC)
+    {
+        modify_operand<mode>(cycles, memory, [this](uint8_t value) {
+            zn_set_status(++value);
+            return value;
+        });
+    }
+    else if constexpr (ins == DEC)
+    {
+        modify_operand<mode>(cycles, memory, [this](uint8_t value) {
+            zn_set_status(--value);
+            return value;
+        });
+    }
+    else if constexpr (ins == INX || ins == INY || ins == DEX || ins == DEY)
+    {
+        cycles--;
+        uint8_t& reg = (ins == INX || ins == DEX) ? X : Y;
+        reg += (ins == INX || ins == INY) ? 1 : -1;
+        zn_set_status(reg);
+    }
+    // ----------------------
+
+    /** Shifts */
+    // ----------------------
+    else if constexpr (ins == ASL)
+    {
+        modify_operand<mode, shiftAccess>(cycles, memory, [this](uint8_t value) { return asl(value); });
+    }
+    else if constexpr (ins == LSR)
+    {
+        modify_operand<mode, shiftAccess>(cycles, memory, [this](uint8_t value) { return lsr(value); });
+    }
+    else if constexpr (ins == ROL)
+    {
+        modify_operand<mode, shiftAccess>(cycles, memory, [this](uint8_t value) { return rol(value); });
+    }
+    else if constexpr (ins == ROR)
+    {
+        modify_operand<mode, shiftAccess>(cycles, memory, [this](uint8_t value) { return ror(value); });
+    }
     // ----------------------
-    
-    instructionTable[INS_JSR] = [&](int32_t& cycles, Mem& memory)
+
+    /** Jumps and calls */
+    // ----------------------
+    else if constexpr (ins == JMP && mode == AddrMode::Absolute)
+    {
+        PC = fetch_word(cycles, memory);
+    }
+    else if constexpr (ins == JMP && mode == AddrMode::Indirect)
+    {
+        uint16_t pointer = fetch_word(cycles, memory);
+        if constexpr (Variant::cmos)
+        {
+            PC = peek_word(pointer, cycles, memory);
+        }
+        else
+        {
+            // the NMOS never carries into the high byte of the pointer, so JMP ($10FF) reads $10FF and $1000
+            uint16_t highAddr = (pointer & 0xFF00) | wrap_zero_page(pointer + 1);
+            cycles -= 2;
+            PC = memory[pointer] | (uint16_t)(memory[highAddr] << 8u);
+        }
+    }
+    else if constexpr (ins == JMP && mode == AddrMode::AbsoluteIndirectX)
+    {
+        uint16_t pointer = fetch_word(cycles, memory) + X;
+        cycles--; // adding X takes a cycle
+        PC = peek_word(pointer, cycles, memory);
+    }
+    else if constexpr (ins == JSR)
     {
         uint16_t SubAddr = fetch_word(cycles, memory);
-        // push return point - 1 on to the stack
-        memory.write_word(PC - 1, get_stack_address(SP), cycles); // push return address on to the stack
-        SP = wrap_stack_address(SP - 1); // We decrement SP by 1 but also need to enforce 8-bit stack pointer wrapping
         cycles--;
+        // push return point - 1 on to the stack, high byte first so it ends up little endian
+        push_byte((PC - 1) >> 8, cycles, memory);
+        push_byte((PC - 1) & 0xFF, cycles, memory);
         PC = SubAddr;
+    }
+    else if constexpr (ins == RTS)
+    {
+        cycles -= 2; // dummy read, then the stack pointer increment
+        uint16_t returnAddr = pull_byte(cycles, memory);
+        returnAddr |= pull_byte(cycles, memory) << 8;
+        PC = returnAddr + 1;
+        cycles--; // incrementing the return address takes a cycle
+    }
+    else if constexpr (ins == BRK)
+    {
+        fetch_byte(cycles, memory); // BRK skips a padding byte
+        push_byte(PC >> 8, cycles, memory);
+        push_byte(PC & 0xFF, cycles, memory);
+        push_byte(get_status(true), cycles, memory);
+        I = 1;
+        if constexpr (Variant::cmos)
+        {
+            D = 0;
+        }
+        PC = peek_word(0xFFFE, cycles, memory);
+    }
+    else if constexpr (ins == RTI)
+    {
+        cycles -= 2;
+        set_status(pull_byte(cycles, memory));
+        uint16_t returnAddr = pull_byte(cycles, memory);
+        returnAddr |= pull_byte(cycles, memory) << 8;
+        PC = returnAddr;
+    }
+    // ----------------------
+
+    /** Branches */
+    // ----------------------
+    else if constexpr (ins == BCC) { branch(!C, cycles, memory); }
+    else if constexpr (ins == BCS) { branch(C, cycles, memory); }
+    else if constexpr (ins == BNE) { branch(!Z, cycles, memory); }
+    else if constexpr (ins == BEQ) { branch(Z, cycles, memory); }
+    else if constexpr (ins == BPL) { branch(!N, cycles, memory); }
+    else if constexpr (ins == BMI) { branch(N, cycles, memory); }
+    else if constexpr (ins == BVC) { branch(!V, cycles, memory); }
+    else if constexpr (ins == BVS) { branch(V, cycles, memory); }
+    else if constexpr (ins == BRA) { branch(true, cycles, memory); }
+    // ----------------------
+
+    /** Status flag changes */
+    // ----------------------
+    else if constexpr (ins == CLC) { cycles--; C = 0; }
+    else if constexpr (ins == CLD) { cycles--; D = 0; }
+    else if constexpr (ins == CLI) { cycles--; I = 0; }
+    else if constexpr (ins == CLV) { cycles--; V = 0; }
+    else if constexpr (ins == SEC) { cycles--; C = 1; }
+    else if constexpr (ins == SED) { cycles--; D = 1; }
+    else if constexpr (ins == SEI) { cycles--; I = 1; }
+    // ----------------------
+
+    // No operation. the operand (if any) is still read, which is what makes the undocumented NOPs differ in length and timing
+    else if constexpr (ins == NOP)
+    {
+        if constexpr (mode == AddrMode::Implied)
+        {
+            cycles--;
+        }
+        else if constexpr (mode != AddrMode::None)
+        {
+            read_operand<mode>(cycles, memory);
+        }
+    }
+
+    /** 65C02 bit manipulation */
+    // ----------------------
+    else if constexpr (ins == TSB)
+    {
+        modify_operand<mode>(cycles, memory, [this](uint8_t value) {
+            Z = (A & value) == 0;
+            return (uint8_t)(value | A);
+        });
+    }
+    else if constexpr (ins == TRB)
+    {
+        modify_operand<mode>(cycles, memory, [this](uint8_t value) {
+            Z = (A & value) == 0;
+            return (uint8_t)(value & ~A);
+        });
+    }
+    else if constexpr (ins == RMB || ins == SMB)
+    {
+        constexpr uint8_t mask = 1 << ((Opcode >> 4) & 7); // the bit number is encoded in the opcode
+        modify_operand<mode>(cycles, memory, [](uint8_t value) {
+            return (uint8_t)(ins == RMB ? value & ~mask : value | mask);
+        });
+    }
+    else if constexpr (ins == BBR || ins == BBS)
+    {
+        constexpr uint8_t mask = 1 << ((Opcode >> 4) & 7);
+        uint8_t zpAddr = AddrZeroPage(cycles, memory);
+        uint8_t value = peek_byte(zpAddr, cycles, memory);
+        cycles--; // the value is read twice
+        branch(((value & mask) != 0) == (ins == BBS), cycles, memory);
+    }
+    else if constexpr (ins == WAI || ins == STP)
+    {
+        // both park the CPU on the instruction. irq() and nmi() wake up a WAI, only a reset gets out of STP.
+        // 3 cycles with the one from the opcode table, and again for every pass while parked
+        PC--;
         cycles--;
-    };
-    
-    // NOP opcode
-    instructionTable[0xEA] = NOP_lambda;
+        waiting = ins == WAI;
+        stopped = ins == STP;
+    }
+    // ----------------------
+
+    /** NMOS undocumented */
+    // ----------------------
+    else if constexpr (ins == LAX)
+    {
+        A = X = read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+    }
+    else if constexpr (ins == SAX)
+    {
+        write_operand<mode>(A & X, cycles, memory);
+    }
+    else if constexpr (ins == SLO)
+    {
+        A |= modify_operand<mode>(cycles, memory, [this](uint8_t value) { return asl(value); });
+        zn_set_status(A);
+    }
+    else if constexpr (ins == RLA)
+    {
+        A &= modify_operand<mode>(cycles, memory, [this](uint8_t value) { return rol(value); });
+        zn_set_status(A);
+    }
+    else if constexpr (ins == SRE)
+    {
+        A ^= modify_operand<mode>(cycles, memory, [this](uint8_t value) { return lsr(value); });
+        zn_set_status(A);
+    }
+    else if constexpr (ins == RRA)
+    {
+        adc(modify_operand<mode>(cycles, memory, [this](uint8_t value) { return ror(value); }), cycles);
+    }
+    else if constexpr (ins == DCP)
+    {
+        compare(A, modify_operand<mode>(cycles, memory, [](uint8_t value) { return (uint8_t)(value - 1); }));
+    }
+    else if constexpr (ins == ISC)
+    {
+        sbc(modify_operand<mode>(cycles, memory, [](uint8_t value) { return (uint8_t)(value + 1); }), cycles);
+    }
+    else if constexpr (ins == ANC)
+    {
+        A &= read_operand<mode>(cycles, memory);
+        zn_set_status(A);
+        C = N;
+    }
+    else if constexpr (ins == ALR)
+    {
+        A = lsr(A & read_operand<mode>(cycles, memory));
+    }
+    else if constexpr (ins == ARR)
+    {
+        uint8_t value = A & read_operand<mode>(cycles, memory);
+        A = (value >> 1) | (C << 7);
+        zn_set_status(A);
+        if (Variant::decimalMode && D)
+        {
+            // decimal ARR fixes up each nibble like a BCD addition would
+            V = ((value ^ A) & 0x40) != 0;
+            if ((value & 0x0F) + (value & 0x01) > 0x05)
+            {
+                A = (A & 0xF0) | ((A + 0x06) & 0x0F);
+            }
+            C = (value & 0xF0) + (value & 0x10) > 0x50;
+            if (C)
+            {
+                A += 0x60;
+            }
+        }
+        else
+        {
+            C = (A & 0x40) != 0;
+            V = ((A >> 6) ^ (A >> 5)) & 1;
+        }
+    }
+    else if constexpr (ins == SBX)
+    {
+        uint8_t operand = read_operand<mode>(cycles, memory);
+        uint8_t value = A & X;
+        C = value >= operand;
+        X = value - operand;
+        zn_set_status(X);
+    }
+    else if constexpr (ins == ANE || ins == LXA)
+    {
+        // unstable on real hardware. 0xEE is the commonly observed "magic" constant
+        uint8_t operand = read_operand<mode>(cycles, memory);
+        A = (A | 0xEE) & operand & (ins == ANE ? X : 0xFF);
+        if constexpr (ins == LXA)
+        {
+            X = A;
+        }
+        zn_set_status(A);
+    }
+    else if constexpr (ins == LAS)
+    {
+        A = X = SP = read_operand<mode>(cycles, memory) & SP;
+        zn_set_status(A);
+    }
+    else if constexpr (ins == SHA)
+    {
+        store_and_high<mode>(A & X, cycles, memory);
+    }
+    else if constexpr (ins == SHX)
+    {
+        store_and_high<mode>(X, cycles, memory);
+    }
+    else if constexpr (ins == SHY)
+    {
+        store_and_high<mode>(Y, cycles, memory);
+    }
+    else if constexpr (ins == TAS)
+    {
+        SP = A & X;
+        store_and_high<mode>(SP, cycles, memory);
+    }
+    else if constexpr (ins == JAM)
+    {
+        // locks up the CPU. it keeps fetching the same opcode until reset, interrupts included
+        PC--;
+        cycles--;
+        stopped = true;
+    }
+    // ----------------------
+    else
+    {
+        static_assert(always_false<ins>, "mnemonic without a handler");
+    }
+
+    if constexpr (info.extraCycles > 0)
+    {
+        cycles -= info.extraCycles;
+    }
+}
+
+template <typename Variant>
+void m6502::BasicCPU<Variant>::adc(uint8_t operand, int32_t& cycles)
+{
+    // D rarely changes, so this is the only branch and it predicts well
+    AluResult result = Variant::decimalMode && D ? alu::adc_decimal<Variant::cmos>(A, operand, C)
+                                                 : alu::adc_binary(A, operand, C);
+    if constexpr (Variant::cmos)
+    {
+        cycles -= D; // the 65C02 spends a cycle making N and Z valid
+    }
+    A = result.value;
+    set_flags<FLAG_N | FLAG_V | FLAG_Z | FLAG_C>(result.flags);
+}
+
+template <typename Variant>
+void m6502::BasicCPU<Variant>::sbc(uint8_t operand, int32_t& cycles)
+{
+    AluResult result = Variant::decimalMode && D ? alu::sbc_decimal<Variant::cmos>(A, operand, C)
+                                                 : alu::sbc_binary(A, operand, C);
+    if constexpr (Variant::cmos)
+    {
+        cycles -= D;
+    }
+    A = result.value;
+    set_flags<FLAG_N | FLAG_V | FLAG_Z | FLAG_C>(result.flags);
 }
 
-uint8_t m6502::CPU::AddrZeroPage(int32_t& cycles, Mem& memory)
+template <typename Variant>
+void m6502::BasicCPU<Variant>::compare(uint8_t registerIn, uint8_t operand)
+{
+    set_flags<FLAG_N | FLAG_Z | FLAG_C>(alu::compare(registerIn, operand).flags);
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::asl(uint8_t value)
+{
+    AluResult result = alu::asl(value);
+    set_flags<FLAG_N | FLAG_Z | FLAG_C>(result.flags);
+    return result.value;
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::lsr(uint8_t value)
+{
+    AluResult result = alu::lsr(value);
+    set_flags<FLAG_N | FLAG_Z | FLAG_C>(result.flags);
+    return result.value;
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::rol(uint8_t value)
+{
+    AluResult result = alu::rol(value, C);
+    set_flags<FLAG_N | FLAG_Z | FLAG_C>(result.flags);
+    return result.value;
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::ror(uint8_t value)
+{
+    AluResult result = alu::ror(value, C);
+    set_flags<FLAG_N | FLAG_Z | FLAG_C>(result.flags);
+    return result.value;
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::AddrZeroPage(int32_t& cycles, Mem& memory)
 {
     return fetch_byte(cycles, memory);
 }
 
-uint8_t m6502::CPU::AddrZeroPageX(int32_t& cycles, Mem& memory)
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::AddrZeroPageX(int32_t& cycles, Mem& memory)
 {
     uint8_t zpAddr = fetch_byte(cycles, memory);
     zpAddr = wrap_zero_page(zpAddr + X);
     cycles--; // adding x to zpAddr takes a cycle
     return zpAddr;
-}
\ No newline at end of file
+}
+
+template <typename Variant>
+uint8_t m6502::BasicCPU<Variant>::AddrZeroPageY(int32_t& cycles, Mem& memory)
+{
+    uint8_t zpAddr = fetch_byte(cycles, memory);
+    zpAddr = wrap_zero_page(zpAddr + Y);
+    cycles--; // adding y to zpAddr takes a cycle
+    return zpAddr;
+}
+
+template <typename Variant>
+template <m6502::Access AccessType>
+uint16_t m6502::BasicCPU<Variant>::AddrAbsoluteIndexed(uint8_t index, int32_t& cycles, Mem& memory)
+{
+    uint16_t baseAddr = fetch_word(cycles, memory);
+    uint16_t effectiveAddr = baseAddr + index;
+    if (AccessType != Access::Read || crosses_page_boundary(effectiveAddr, baseAddr))
+    {
+        cycles--;
+    }
+    return effectiveAddr;
+}
+
+template <typename Variant>
+uint16_t m6502::BasicCPU<Variant>::AddrIndirectX(int32_t& cycles, Mem& memory)
+{
+    uint8_t zpAddr = AddrZeroPageX(cycles, memory);
+    return peek_zero_page_word(zpAddr, cycles, memory);
+}
+
+template <typename Variant>
+template <m6502::Access AccessType>
+uint16_t m6502::BasicCPU<Variant>::AddrIndirectY(int32_t& cycles, Mem& memory)
+{
+    uint8_t zpAddr = fetch_byte(cycles, memory);
+    uint16_t baseAddr = peek_zero_page_word(zpAddr, cycles, memory);
+    uint16_t effectiveAddr = baseAddr + Y;
+    if (AccessType != Access::Read || crosses_page_boundary(effectiveAddr, baseAddr))
+    {
+        cycles--;
+    }
+    return effectiveAddr;
+}
+
+template <typename Variant>
+template <m6502::AddrMode Mode, m6502::Access AccessType>
+uint16_t m6502::BasicCPU<Variant>::effective_address(int32_t& cycles, Mem& memory)
+{
+    if constexpr (Mode == AddrMode::ZeroPage)
+    {
+        return AddrZeroPage(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::ZeroPageX)
+    {
+        return AddrZeroPageX(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::ZeroPageY)
+    {
+        return AddrZeroPageY(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::Absolute)
+    {
+        return fetch_word(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::AbsoluteX)
+    {
+        return AddrAbsoluteIndexed<AccessType>(X, cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::AbsoluteY)
+    {
+        return AddrAbsoluteIndexed<AccessType>(Y, cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::IndirectX)
+    {
+        return AddrIndirectX(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::IndirectY)
+    {
+        return AddrIndirectY<AccessType>(cycles, memory);
+    }
+    else if constexpr (Mode == AddrMode::ZeroPageIndirect)
+    {
+        uint8_t zpAddr = fetch_byte(cycles, memory);
+        return peek_zero_page_word(zpAddr, cycles, memory);
+    }
+    else
+    {
+        static_assert(always_false<Mode>, "addressing mode has no effective address");
+    }
+}
+
+template <typename Variant>
+template <m6502::AddrMode Mode>
+uint8_t m6502::BasicCPU<Variant>::read_operand(int32_t& cycles, Mem& memory)
+{
+    if constexpr (Mode == AddrMode::Immediate)
+    {
+        return fetch_byte(cycles, memory);
+    }
+    else
+    {
+        uint16_t address = effective_address<Mode, Access::Read>(cycles, memory);
+        return peek_byte(address, cycles, memory);
+    }
+}
+
+template <typename Variant>
+template <m6502::AddrMode Mode>
+void m6502::BasicCPU<Variant>::write_operand(uint8_t value, int32_t& cycles, Mem& memory)
+{
+    uint16_t address = effective_address<Mode, Access::Write>(cycles, memory);
+    poke_byte(address, value, cycles, memory);
+}
+
+template <typename Variant>
+template <m6502::AddrMode Mode, m6502::Access IndexAccess, typename Operation>
+uint8_t m6502::BasicCPU<Variant>::modify_operand(int32_t& cycles, Mem& memory, Operation operation)
+{
+    if constexpr (Mode == AddrMode::Accumulator)
+    {
+        cycles--;
+        A = operation(A);
+        return A;
+    }
+    else
+    {
+        uint16_t address = effective_address<Mode, IndexAccess>(cycles, memory);
+        uint8_t value = peek_byte(address, cycles, memory);
+        cycles--; // the NMOS writes the unmodified value back, the 65C02 reads it again
+        value = operation(value);
+        poke_byte(address, value, cycles, memory);
+        return value;
+    }
+}
+
+template <typename Variant>
+void m6502::BasicCPU<Variant>::branch(bool condition, int32_t& cycles, Mem& memory)
+{
+    int8_t offset = static_cast<int8_t>(fetch_byte(cycles, memory));
+    if (condition)
+    {
+        cycles--;
+        uint16_t target = PC + offset;
+        if (crosses_page_boundary(target, PC))
+        {
+            cycles--;
+        }
+        PC = target;
+    }
+}
+
+template <typename Variant>
+template <m6502::AddrMode Mode>
+void m6502::BasicCPU<Variant>::store_and_high(uint8_t value, int32_t& cycles, Mem& memory)
+{
+    uint16_t baseAddr;
+    uint8_t index;
+    if constexpr (Mode == AddrMode::IndirectY)
+    {
+        uint8_t zpAddr = fetch_byte(cycles, memory);
+        baseAddr = peek_zero_page_word(zpAddr, cycles, memory);
+        index = Y;
+    }
+    else
+    {
+        baseAddr = fetch_word(cycles, memory);
+        index = Mode == AddrMode::AbsoluteX ? X : Y;
+    }
+    cycles--; // stores always pay the index cycle
+
+    uint16_t effectiveAddr = baseAddr + index;
+    value &= (baseAddr >> 8) + 1;
+    if (crosses_page_boundary(effectiveAddr, baseAddr))
+    {
+        effectiveAddr = (value << 8) | (effectiveAddr & 0xFF);
+    }
+    poke_byte(effectiveAddr, value, cycles, memory);
+}
+
+// one fully specialized dispatch per variant
+template class m6502::BasicCPU<m6502::NMOS>;
+template class m6502::BasicCPU<m6502::NMOSIllegal>;
+template class m6502::BasicCPU<m6502::CMOS65C02>;
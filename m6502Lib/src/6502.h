@@ -4,7 +4,11 @@
 #include <iostream>
 #include <cstdint>
 #include <memory>
-#include <functional>
+#include <utility>
+
+#include "6502ALU.h"
+#include "6502Fusion.h"
+#include "6502Variants.h"
 
 // modeling after the 6502 (see http://www.6502.org/users/obelisk/)
 // uint8_t = byte
@@ -13,24 +17,109 @@
 namespace m6502
 {
     struct Mem;
-    class CPU;
-    
-    //using InstructionHandler = void (CPU::*)(int32_t& cycles, Mem& mem);
-    // Instruction Handler is a function pointer taking a ref to cycles and memory. 
-    using InstructionHandler = std::function<void(int32_t& cycles, Mem& memory)>;
+    template <typename Variant> class BasicCPU;
+    class InputSource; // see 6502Replay.h
+
+    /** a host device watching writes to its pages */
+    class OutputSink
+    {
+    public:
+        virtual ~OutputSink() = default;
+        /** called once value is in memory. cycle is BasicCPU::cycleCount as of the end of the write.
+         *  @return true to end the running execute() once the current instruction is done */
+        virtual bool write(uint16_t address, uint8_t value, uint64_t cycle) = 0;
+    };
+
+    // one CPU type per supported derivative. see 6502Variants.h
+    using CPU = BasicCPU<NMOS>;
+    using CPUIllegal = BasicCPU<NMOSIllegal>;
+    using CPU65C02 = BasicCPU<CMOS65C02>;
+
+    // how an instruction uses its operand. decides whether indexing always costs the extra cycle
+    enum class Access
+    {
+        Read,   // extra cycle only when indexing crosses a page
+        Write,  // extra cycle always
+        Modify, // extra cycle always
+    };
 }
 
 // 64 KB of memory
 struct m6502::Mem
 {
     static constexpr size_t MEM_SIZE = 64 * 1024; // 64 KB
+    static constexpr size_t PAGE_SIZE = 256;
+    static constexpr size_t PAGE_COUNT = MEM_SIZE / PAGE_SIZE;
+    // one bit per page, page N is bit N % 64 of word N / 64
+    using DirtyPages = std::array<uint64_t, PAGE_COUNT / 64>;
+
     std::array<uint8_t, MEM_SIZE> mem;
+    // pages written through the CPU (or marked by the host) since the marks were last taken. starts out all dirty
+    DirtyPages dirtyPages = all_pages_dirty();
+    // taking the marks folds them in here, so consumers sharing a Mem each keep their own position (see dirty_pages_since())
+    uint64_t dirtyVersion = 0;
+    // the dirtyVersion each page was last taken dirty in
+    std::array<uint64_t, PAGE_COUNT> pageVersions{};
 
     void initialize()
     {
         mem.fill(0);
+        mark_all_dirty();
+    }
+
+    // the CPU marks every page it writes. hosts writing through operator[] mark the pages themselves
+    inline void mark_dirty(uint16_t address)
+    {
+        dirtyPages[address >> 14] |= 1ull << ((address >> 8) & 63);
     }
 
+    inline void mark_all_dirty()
+    {
+        dirtyPages = all_pages_dirty();
+    }
+
+    inline bool is_dirty(size_t page) const
+    {
+        return (dirtyPages[page / 64] >> (page % 64)) & 1;
+    }
+
+    /** @return the pages marked dirty since the marks were last taken by anyone, and clears them. for a Mem with a single consumer */
+    DirtyPages take_dirty_pages();
+    /** @return the pages marked dirty since this consumer's previous call, and clears the marks without hiding them from
+     *  other consumers. version is the consumer's position, 0 to start with, which gets every page */
+    DirtyPages dirty_pages_since(uint64_t& version);
+
+    static constexpr DirtyPages all_pages_dirty()
+    {
+        DirtyPages dirty;
+        dirty.fill(~0ull);
+        return dirty;
+    }
+
+    // marks every page in [address, address + length), wrapping at $FFFF. one bit per page, not per byte
+    void mark_dirty_range(uint16_t address, size_t length);
+
+    #pragma region block transfers
+
+    // bulk access for host tools and device models (loaders, DMA). addresses wrap from $FFFF to $0000 like the
+    // CPU's do, and everything is done a linear span at a time with the C library's vectorized mem* routines.
+    // writes mark their pages dirty once per page
+
+    /** copies length bytes (at most MEM_SIZE) of data to address */
+    void load_block(uint16_t address, const uint8_t* data, size_t length);
+    /** copies length bytes (at most MEM_SIZE) at address out to data */
+    void read_block(uint16_t address, uint8_t* data, size_t length) const;
+    /** copies length bytes (at most MEM_SIZE) from source to destination. overlapping blocks behave like memmove */
+    void copy_block(uint16_t destination, uint16_t source, size_t length);
+    /** sets length bytes (at most MEM_SIZE) at address to value */
+    void fill(uint16_t address, uint8_t value, size_t length);
+    /** compares length bytes at address with data. @return <0, 0 or >0 like memcmp */
+    int compare(uint16_t address, const uint8_t* data, size_t length) const;
+    /** searches the range bytes from start for pattern, matches may wrap past $FFFF. @return the address of the first match, or -1 */
+    int32_t find_pattern(const uint8_t* pattern, size_t length, uint16_t start = 0, size_t range = MEM_SIZE) const;
+
+    #pragma endregion
+
     // read one byte
     inline uint8_t operator[](size_t address) const
     {
@@ -51,20 +140,19 @@ struct m6502::Mem
         // least significant byte goes in first because little endian
         mem[address] = (value & 0xFF);
         mem[address + 1] = value >> 8;
+        mark_dirty(address);
+        mark_dirty(address + 1);
         cycles -= 2;
     }
 
 };
 
 // 6502 microprocessor. 8-bit cpu, 16-bit memory bus, little endian
-class m6502::CPU
+// The Variant (see 6502Variants.h) picks the opcode map and the derivative specific behavior at compile time.
+template <typename Variant>
+class m6502::BasicCPU
 {
 public:
-    CPU()
-    {
-        initialize_instruction_table();
-    }
-    
     // the program counter
     uint16_t PC;
     // stack pointer
@@ -95,10 +183,31 @@ public:
         A = X = Y = 0;
         // reset the flags
         C = Z = I = D = B = V = N = 0;
+        cycleCount = 0;
+        instructionCount = 0;
+        waiting = false;
+        stopped = false;
         // initialize the memory. note that the CPU doesn't do anything else with it
         mem.initialize();
     }
 
+    // packs the flags into the processor status byte. the B bit only exists on the stack
+    inline uint8_t get_status(bool breakFlag) const
+    {
+        return (C ? FLAG_C : 0) | (Z ? FLAG_Z : 0) | (I ? FLAG_I : 0) | (D ? FLAG_D : 0)
+            | (breakFlag ? FLAG_B : 0) | FLAG_UNUSED | (V ? FLAG_V : 0) | (N ? FLAG_N : 0);
+    }
+
+    // unpacks a processor status byte (PLP/RTI). B and the unused bit are ignored
+    inline void set_status(uint8_t status)
+    {
+        C = (status & FLAG_C) != 0;
+        Z = (status & FLAG_Z) != 0;
+        I = (status & FLAG_I) != 0;
+        D = (status & FLAG_D) != 0;
+        V = (status & FLAG_V) != 0;
+        N = (status & FLAG_N) != 0;
+    }
 
     // opcodes
     static constexpr uint8_t
@@ -128,18 +237,114 @@ public:
         INS_JSR         = 0x0020    // JSR Absolute
     ;
     
+    // superinstructions, see 6502Fusion.h. registers, memory and cycle counts are the same either way
+    bool fusionEnabled = true;
+    // when set, execute() counts the fused sequences and the remaining dispatched opcode pairs here
+    FusionStats* fusionStats = nullptr;
+
+    // cycles run since reset(), including interrupt entries
+    uint64_t cycleCount = 0;
+    // instructions retired since reset(), fused ones included
+    uint64_t instructionCount = 0;
+
+    // reads of the pages set in inputPages come from inputSource (host devices, or a replay) instead of memory
+    InputSource* inputSource = nullptr;
+    std::array<bool, Mem::PAGE_COUNT> inputPages{};
+    // writes to the pages set in outputPages are also passed to outputSink. memory is written either way
+    OutputSink* outputSink = nullptr;
+    std::array<bool, Mem::PAGE_COUNT> outputPages{};
+
     /** @return the number of cycles it took*/
     int32_t execute(int32_t cycles, Mem& memory);
 
+    /** asserts IRQ between instructions. unless I is set, pushes PC and the status and jumps through $FFFE. takes 7 cycles if taken.
+     *  either way it wakes the CPU up from a WAI. a CPU halted by STP or JAM ignores it. @return whether the interrupt was taken */
+    bool irq(Mem& memory);
+    /** asserts NMI between instructions. like irq(), but through $FFFA and it can't be masked. ignored after STP or JAM too */
+    void nmi(Mem& memory);
+
+    /** halted by STP (65C02) or JAM (NMOS). only reset() gets it going again */
+    bool is_stopped() const { return stopped; }
+
+    /** like execute(), but checks stop(cpu, memory) before every instruction and returns early once it is true.
+     *  cycleCount is up to date whenever stop() is called. runs unfused so no instruction is skipped over.
+     *  @return the number of cycles it took */
+    template <typename StopCondition>
+    int32_t execute_until(int32_t cycles, Mem& memory, StopCondition&& stop)
+    {
+        const uint64_t cycleStart = cycleCount;
+        cycleEnd = cycleCount + cycles;
+        uint64_t retired = 0;
+        while (cycles > 0)
+        {
+            cycleCount = cycleEnd - cycles;
+            if (stop(*this, memory))
+            {
+                break;
+            }
+            uint8_t opCode = fetch_byte(cycles, memory);
+            auto handler = instructionTable[opCode];
+            handler(*this, cycles, memory);
+            retired++;
+        }
+
+        instructionCount += retired;
+        cycleCount = cycleEnd - cycles;
+        return static_cast<int32_t>(cycleCount - cycleStart);
+    }
+
 private:
 
-    // 6502 has 256 total opcodes
-    InstructionHandler instructionTable[256];
+    // Instruction Handler is a plain function pointer taking the cpu, a ref to cycles and memory.
+    using InstructionHandler = void (*)(BasicCPU& cpu, int32_t& cycles, Mem& memory);
 
-    void initialize_instruction_table();
+    // 6502 has 256 total opcodes. built at compile time from Variant::opcodes, one specialized handler per opcode
+    static const std::array<InstructionHandler, 256> instructionTable;
+
+    // the same, except that the first opcode of every FUSION_PATTERNS entry gets a fused handler
+    static const std::array<InstructionHandler, 256> fusedInstructionTable;
+
+    template <size_t... Opcodes>
+    static constexpr std::array<InstructionHandler, 256> make_instruction_table(std::index_sequence<Opcodes...>);
+    template <size_t... Opcodes>
+    static constexpr std::array<InstructionHandler, 256> make_fused_instruction_table(std::index_sequence<Opcodes...>);
+
+    template <uint8_t Opcode>
+    static void dispatch(BasicCPU& cpu, int32_t& cycles, Mem& memory)
+    {
+        cpu.execute_opcode<Opcode>(cycles, memory);
+    }
+
+    template <uint8_t Opcode, size_t Pattern>
+    static void dispatch_fused(BasicCPU& cpu, int32_t& cycles, Mem& memory)
+    {
+        cpu.execute_opcode<Opcode>(cycles, memory);
+        cpu.continue_fusion<Pattern, 1>(cycles, memory);
+    }
+
+    /** runs step Step of a fusion pattern if the next opcode matches and the cycle budget isn't used up */
+    template <size_t Pattern, size_t Step>
+    inline void continue_fusion(int32_t& cycles, Mem& memory);
+
+    /** execute() while collecting fusionStats */
+    int32_t execute_with_stats(int32_t cycles, Mem& memory);
+
+    /** executes everything after the opcode fetch. the behavior is resolved from Variant::opcodes[Opcode] */
+    template <uint8_t Opcode>
+    void execute_opcode(int32_t& cycles, Mem& memory);
+
+    /** the IRQ/NMI entry sequence */
+    void interrupt(uint16_t vector, Mem& memory);
+
+    // what cycleCount will be once the budget of the running execute() is used up. cycleEnd - cycles is the current cycle
+    uint64_t cycleEnd = 0;
+    // parked on a WAI
+    bool waiting = false;
+    // halted by STP or JAM
+    bool stopped = false;
 
 protected:
-    
+
     inline uint16_t get_stack_address(uint8_t stackPointer)
     {
         return 0x0100 | stackPointer; // Stacks are always within page 0x01, but the stackPointer variable is 8 bit so it can't actually hold 0x01FF
@@ -161,7 +366,7 @@ protected:
     inline uint16_t fetch_word(int32_t& cycles, const Mem& memory)
     {
         // 6502 is little endian, lower byte comes first
-        uint16_t data = memory[PC] | (uint16_t)(memory[PC + 1] << 8u); // bitshift promotes memory[PC + 1] to an unsigned int so we cast it back
+        uint16_t data = memory[PC] | (uint16_t)(memory[(uint16_t)(PC + 1)] << 8u); // bitshift promotes memory[PC + 1] to an unsigned int so we cast it back
         PC += 2;
         cycles -= 2;
         // if I wanted to handle endianness, I would have to swap bytes here
@@ -173,18 +378,66 @@ protected:
     inline uint8_t peek_byte(uint16_t address, int32_t& cycles, const Mem& memory)
     {
         cycles--;
+        if (inputSource != nullptr && inputPages[address >> 8]) [[unlikely]]
+        {
+            return read_input(address, cycles);
+        }
         return memory[address];
     }
+    // a data read from an input page, stamped with the cycle it happens in
+    uint8_t read_input(uint16_t address, int32_t cycles);
+    // passes a write to an output page on to outputSink, and ends the budget if it asks to
+    void write_output(uint16_t address, uint8_t value, int32_t& cycles);
     // peeks a word at an address. takes 2 cycles but does not change program counter
     inline uint16_t peek_word(uint16_t address, int32_t& cycles, const Mem& memory)
     {
         cycles -= 2;
-        return memory[address] | (uint16_t)(memory[address + 1] << 8u); // could also do peek_byte(address) | (peek_byte(address + 1) << 8) and not change the cycles here
+        return memory[address] | (uint16_t)(memory[(uint16_t)(address + 1)] << 8u); // could also do peek_byte(address) | (peek_byte(address + 1) << 8) and not change the cycles here
+    }
+    // peeks a pointer stored in the zero page. the high byte wraps around to 0x00 instead of leaving the page
+    inline uint16_t peek_zero_page_word(uint8_t address, int32_t& cycles, const Mem& memory)
+    {
+        cycles -= 2;
+        return memory[address] | (uint16_t)(memory[wrap_zero_page(address + 1)] << 8u);
+    }
+    // writes a byte to an address and marks its page dirty. takes a cycle
+    inline void poke_byte(uint16_t address, uint8_t value, int32_t& cycles, Mem& memory)
+    {
+        cycles--;
+        memory[address] = value;
+        memory.mark_dirty(address);
+        if (outputSink != nullptr && outputPages[address >> 8]) [[unlikely]]
+        {
+            write_output(address, value, cycles);
+        }
+    }
+
+    // pushes a byte on to the stack. takes a cycle
+    inline void push_byte(uint8_t value, int32_t& cycles, Mem& memory)
+    {
+        poke_byte(get_stack_address(SP), value, cycles, memory);
+        SP = wrap_stack_address(SP - 1);
+    }
+    // pulls a byte from the stack. takes a cycle, the preceding stack pointer increment is up to the caller
+    inline uint8_t pull_byte(int32_t& cycles, const Mem& memory)
+    {
+        SP = wrap_stack_address(SP + 1);
+        return peek_byte(get_stack_address(SP), cycles, memory);
     }
 
 
     #pragma region helpers
 
+    // copies the flags selected by Mask (FLAG_* bits) out of a packed status byte, such as an AluResult's
+    template <uint8_t Mask>
+    inline void set_flags(uint8_t flags)
+    {
+        if constexpr ((Mask & FLAG_C) != 0) C = (flags & FLAG_C) != 0;
+        if constexpr ((Mask & FLAG_Z) != 0) Z = (flags & FLAG_Z) != 0;
+        if constexpr ((Mask & FLAG_V) != 0) V = (flags & FLAG_V) != 0;
+        if constexpr ((Mask & FLAG_N) != 0) N = (flags & FLAG_N) != 0;
+    }
+
     // previously LDASetStatus(), but we can specify a register we want to pass in for this one. It is supposed to be used after we load a register.
     inline void zn_set_status(uint8_t registerIn)
     {
@@ -205,10 +458,64 @@ protected:
 
     #pragma endregion
 
+    #pragma region alu
+
+    // thin wrappers applying the results of 6502ALU.h to the registers
+
+    /** Add with carry. honours decimal mode when the variant supports it */
+    inline void adc(uint8_t operand, int32_t& cycles);
+    /** Subtract with borrow. honours decimal mode when the variant supports it */
+    inline void sbc(uint8_t operand, int32_t& cycles);
+    /** CMP/CPX/CPY. sets C, Z and N as if registerIn - operand */
+    inline void compare(uint8_t registerIn, uint8_t operand);
+
+    inline uint8_t asl(uint8_t value);
+    inline uint8_t lsr(uint8_t value);
+    inline uint8_t rol(uint8_t value);
+    inline uint8_t ror(uint8_t value);
+
+    #pragma endregion
+
     /** Addressing mode - Zero page */
     inline uint8_t AddrZeroPage(int32_t& cycles, Mem& memory);
     /** Addressing mode - Zero page, X */
     inline uint8_t AddrZeroPageX(int32_t& cycles, Mem& memory);
     /** Addressing mode - Zero page, Y */
     inline uint8_t AddrZeroPageY(int32_t& cycles, Mem& memory);
-};
\ No newline at end of file
+    /** Addressing mode - Absolute, X or Y. the index cycle depends on the access */
+    template <Access AccessType>
+    inline uint16_t AddrAbsoluteIndexed(uint8_t index, int32_t& cycles, Mem& memory);
+    /** Addressing mode - Indirect, X */
+    inline uint16_t AddrIndirectX(int32_t& cycles, Mem& memory);
+    /** Addressing mode - Indirect, Y. the index cycle depends on the access */
+    template <Access AccessType>
+    inline uint16_t AddrIndirectY(int32_t& cycles, Mem& memory);
+
+    /** resolves the effective address of any memory addressing mode */
+    template <AddrMode Mode, Access AccessType>
+    inline uint16_t effective_address(int32_t& cycles, Mem& memory);
+
+    /** reads the operand of a read instruction (LDA, ADC, CMP, ...) */
+    template <AddrMode Mode>
+    inline uint8_t read_operand(int32_t& cycles, Mem& memory);
+    /** writes the result of a store instruction (STA, STZ, SAX, ...) */
+    template <AddrMode Mode>
+    inline void write_operand(uint8_t value, int32_t& cycles, Mem& memory);
+    /** read-modify-write of the operand (ASL, INC, DCP, ...). returns the written value */
+    template <AddrMode Mode, Access IndexAccess = Access::Modify, typename Operation>
+    inline uint8_t modify_operand(int32_t& cycles, Mem& memory, Operation operation);
+
+    /** taken branches cost a cycle, and another if the target is on a different page */
+    inline void branch(bool condition, int32_t& cycles, Mem& memory);
+    /** undocumented SHA/SHX/SHY/TAS store. the value is ANDed with the base high byte + 1, which also corrupts a page crossing address */
+    template <AddrMode Mode>
+    inline void store_and_high(uint8_t value, int32_t& cycles, Mem& memory);
+};
+
+namespace m6502
+{
+    // the handlers are instantiated once in 6502.cpp
+    extern template class BasicCPU<NMOS>;
+    extern template class BasicCPU<NMOSIllegal>;
+    extern template class BasicCPU<CMOS65C02>;
+}
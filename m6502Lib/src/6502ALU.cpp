@@ -0,0 +1,30 @@
+﻿#include "6502ALU.h"
+
+namespace
+{
+    using m6502::AluResult;
+    using m6502::alu::DecimalTable;
+
+    // runs the reference implementation over every (carry, A, operand)
+    DecimalTable make_decimal_table(AluResult (*operation)(uint8_t, uint8_t, uint8_t, bool, bool), bool cmos)
+    {
+        DecimalTable table;
+        for (uint32_t carry = 0; carry < 2; carry++)
+        {
+            for (uint32_t a = 0; a < 256; a++)
+            {
+                for (uint32_t operand = 0; operand < 256; operand++)
+                {
+                    AluResult result = operation(a, operand, carry, true, cmos);
+                    table[m6502::alu::decimal_index(a, operand, carry)] = result.value | (result.flags << 8);
+                }
+            }
+        }
+        return table;
+    }
+}
+
+const DecimalTable m6502::alu::nmosDecimalADC = make_decimal_table(&reference::adc, false);
+const DecimalTable m6502::alu::nmosDecimalSBC = make_decimal_table(&reference::sbc, false);
+const DecimalTable m6502::alu::cmosDecimalADC = make_decimal_table(&reference::adc, true);
+const DecimalTable m6502::alu::cmosDecimalSBC = make_decimal_table(&reference::sbc, true);
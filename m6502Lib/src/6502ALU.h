@@ -0,0 +1,266 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Arithmetic and logic unit. Every operation returns the result together with the affected flags packed as in the
+// processor status byte, and is computed without data dependent branches: binary arithmetic is plain integer math,
+// decimal mode is a lookup in a precomputed table indexed by (carry, A, operand).
+
+namespace m6502
+{
+    // processor status flag bits, as pushed by PHP/BRK
+    constexpr uint8_t
+        FLAG_C      = 0x01,
+        FLAG_Z      = 0x02,
+        FLAG_I      = 0x04,
+        FLAG_D      = 0x08,
+        FLAG_B      = 0x10,
+        FLAG_UNUSED = 0x20,     // always reads back as 1
+        FLAG_V      = 0x40,
+        FLAG_N      = 0x80
+    ;
+
+    struct AluResult
+    {
+        uint8_t value;
+        uint8_t flags; // FLAG_* bits. only the flags the operation affects are meaningful
+    };
+}
+
+namespace m6502::alu
+{
+    constexpr std::array<uint8_t, 256> make_zn_table()
+    {
+        std::array<uint8_t, 256> table{};
+        for (size_t value = 0; value < table.size(); value++)
+        {
+            table[value] = (value == 0 ? FLAG_Z : 0) | (value & FLAG_N);
+        }
+        return table;
+    }
+
+    // Z and N for every possible result
+    inline constexpr std::array<uint8_t, 256> ZN_FLAGS = make_zn_table();
+
+    // 128K entries, one per (carry, A, operand). the result is in the low byte and the N, V, Z and C flags in the high byte
+    using DecimalTable = std::array<uint16_t, 2 * 256 * 256>;
+
+    extern const DecimalTable nmosDecimalADC;
+    extern const DecimalTable nmosDecimalSBC;
+    extern const DecimalTable cmosDecimalADC;
+    extern const DecimalTable cmosDecimalSBC;
+
+    inline size_t decimal_index(uint8_t a, uint8_t operand, uint8_t carry)
+    {
+        return (size_t)carry << 16 | (size_t)a << 8 | operand;
+    }
+
+    inline AluResult unpack_decimal(uint16_t entry)
+    {
+        return {(uint8_t)(entry & 0xFF), (uint8_t)(entry >> 8)};
+    }
+
+    /** binary ADC. sets N, V, Z and C */
+    inline AluResult adc_binary(uint8_t a, uint8_t operand, uint8_t carry)
+    {
+        uint32_t sum = a + operand + carry;
+        uint8_t value = sum & 0xFF;
+        uint8_t overflow = (~(a ^ operand) & (a ^ value) & 0x80) >> 1; // same sign operands, different sign result. lands on FLAG_V
+        return {value, (uint8_t)(ZN_FLAGS[value] | overflow | (sum >> 8))};
+    }
+
+    /** binary SBC. A - operand - borrow is A + ~operand + carry */
+    inline AluResult sbc_binary(uint8_t a, uint8_t operand, uint8_t carry)
+    {
+        return adc_binary(a, ~operand, carry);
+    }
+
+    /** decimal ADC. the 65C02 has valid N and Z */
+    template <bool Cmos>
+    inline AluResult adc_decimal(uint8_t a, uint8_t operand, uint8_t carry)
+    {
+        const DecimalTable& table = Cmos ? cmosDecimalADC : nmosDecimalADC;
+        return unpack_decimal(table[decimal_index(a, operand, carry)]);
+    }
+
+    /** decimal SBC. the 65C02 has valid N and Z and differs for invalid BCD operands */
+    template <bool Cmos>
+    inline AluResult sbc_decimal(uint8_t a, uint8_t operand, uint8_t carry)
+    {
+        const DecimalTable& table = Cmos ? cmosDecimalSBC : nmosDecimalSBC;
+        return unpack_decimal(table[decimal_index(a, operand, carry)]);
+    }
+
+    /** CMP/CPX/CPY. sets N, Z and C as if registerIn - operand */
+    inline AluResult compare(uint8_t registerIn, uint8_t operand)
+    {
+        uint32_t difference = registerIn + (uint8_t)~operand + 1; // bit 8 is set when there is no borrow
+        uint8_t value = difference & 0xFF;
+        return {value, (uint8_t)(ZN_FLAGS[value] | (difference >> 8))};
+    }
+
+    inline AluResult asl(uint8_t value)
+    {
+        uint8_t result = value << 1;
+        return {result, (uint8_t)(ZN_FLAGS[result] | (value >> 7))};
+    }
+
+    inline AluResult lsr(uint8_t value)
+    {
+        uint8_t result = value >> 1;
+        return {result, (uint8_t)(ZN_FLAGS[result] | (value & FLAG_C))};
+    }
+
+    inline AluResult rol(uint8_t value, uint8_t carry)
+    {
+        uint8_t result = (value << 1) | carry;
+        return {result, (uint8_t)(ZN_FLAGS[result] | (value >> 7))};
+    }
+
+    inline AluResult ror(uint8_t value, uint8_t carry)
+    {
+        uint8_t result = (value >> 1) | (carry << 7);
+        return {result, (uint8_t)(ZN_FLAGS[result] | (value & FLAG_C))};
+    }
+}
+
+// Straightforward implementations. They generate the decimal tables, and the binary fast paths are tested and benchmarked
+// against them. The decimal tables are tested against an independent model and golden checksums instead
+namespace m6502::alu::reference
+{
+    inline AluResult zn_result(uint8_t value, uint8_t flags)
+    {
+        if (value == 0)
+        {
+            flags |= FLAG_Z;
+        }
+        if (value & 0x80)
+        {
+            flags |= FLAG_N;
+        }
+        return {value, flags};
+    }
+
+    // see http://www.6502.org/tutorials/decimal_mode.html, appendix A
+    inline AluResult adc(uint8_t a, uint8_t operand, uint8_t carry, bool decimal, bool cmos)
+    {
+        uint8_t flags = 0;
+        if (!decimal)
+        {
+            int32_t sum = a + operand + carry;
+            int32_t signedSum = (int8_t)a + (int8_t)operand + carry;
+            if (sum > 0xFF)
+            {
+                flags |= FLAG_C;
+            }
+            if (signedSum < -128 || signedSum > 127)
+            {
+                flags |= FLAG_V;
+            }
+            return zn_result(sum & 0xFF, flags);
+        }
+
+        int32_t lowNibble = (a & 0x0F) + (operand & 0x0F) + carry;
+        if (lowNibble >= 0x0A)
+        {
+            lowNibble = ((lowNibble + 0x06) & 0x0F) + 0x10;
+        }
+        int32_t sum = (a & 0xF0) + (operand & 0xF0) + lowNibble;
+        int32_t signedSum = (int8_t)(a & 0xF0) + (int8_t)(operand & 0xF0) + lowNibble;
+        if (signedSum < -128 || signedSum > 127)
+        {
+            flags |= FLAG_V;
+        }
+        if (!cmos)
+        {
+            // the NMOS takes N from the unadjusted sum and Z from the binary sum
+            if (sum & 0x80)
+            {
+                flags |= FLAG_N;
+            }
+            if (((a + operand + carry) & 0xFF) == 0)
+            {
+                flags |= FLAG_Z;
+            }
+        }
+        if (sum >= 0xA0)
+        {
+            sum += 0x60;
+        }
+        if (sum >= 0x100)
+        {
+            flags |= FLAG_C;
+        }
+        if (cmos)
+        {
+            return zn_result(sum & 0xFF, flags);
+        }
+        return {(uint8_t)(sum & 0xFF), flags};
+    }
+
+    inline AluResult sbc(uint8_t a, uint8_t operand, uint8_t carry, bool decimal, bool cmos)
+    {
+        // C and V are always those of the binary subtraction. so are N and Z on the NMOS
+        int32_t difference = a - operand - (1 - carry);
+        int32_t signedDifference = (int8_t)a - (int8_t)operand - (1 - carry);
+        uint8_t flags = 0;
+        if (difference >= 0)
+        {
+            flags |= FLAG_C;
+        }
+        if (signedDifference < -128 || signedDifference > 127)
+        {
+            flags |= FLAG_V;
+        }
+        if (!decimal)
+        {
+            return zn_result(difference & 0xFF, flags);
+        }
+
+        int32_t lowNibble = (a & 0x0F) - (operand & 0x0F) + carry - 1;
+        int32_t result;
+        if (cmos)
+        {
+            result = difference;
+            if (result < 0)
+            {
+                result -= 0x60;
+            }
+            if (lowNibble < 0)
+            {
+                result -= 0x06;
+            }
+            return zn_result(result & 0xFF, flags);
+        }
+
+        if (lowNibble < 0)
+        {
+            lowNibble = ((lowNibble - 0x06) & 0x0F) - 0x10;
+        }
+        result = (a & 0xF0) - (operand & 0xF0) + lowNibble;
+        if (result < 0)
+        {
+            result -= 0x60;
+        }
+        AluResult binary = zn_result(difference & 0xFF, flags);
+        return {(uint8_t)(result & 0xFF), binary.flags};
+    }
+
+    inline AluResult compare(uint8_t registerIn, uint8_t operand)
+    {
+        return zn_result(registerIn - operand, registerIn >= operand ? FLAG_C : 0);
+    }
+
+    inline AluResult shift(uint8_t value, uint8_t carry, bool left, bool rotate)
+    {
+        uint8_t carryOut = left ? value >> 7 : value & 0x01;
+        uint8_t result = left ? value << 1 : value >> 1;
+        if (rotate)
+        {
+            result |= left ? carry : carry << 7;
+        }
+        return zn_result(result, carryOut ? FLAG_C : 0);
+    }
+}
@@ -0,0 +1,556 @@
+﻿#include "6502Explore.h"
+#include "6502StateHash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t INVALID_ID = UINT32_MAX;
+
+    // splitmix64's finalizer
+    inline uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    uint64_t hash_ids(const uint32_t* ids, size_t count, uint64_t seed)
+    {
+        uint64_t hash = mix64(seed);
+        for (size_t i = 0; i < count; i++)
+        {
+            hash = mix64(hash ^ ids[i]);
+        }
+        return hash;
+    }
+}
+
+m6502::BlockStore::BlockStore(size_t blockSize)
+    : blockSize(blockSize), shards(new Shard[SHARDS]), slabs(new std::atomic<uint8_t*>[MAX_SLABS]())
+{
+}
+
+m6502::BlockStore::~BlockStore()
+{
+    for (size_t slab = 0; slab < MAX_SLABS; slab++)
+    {
+        delete[] slabs[slab].load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t m6502::BlockStore::intern(const uint8_t* block, uint64_t hash)
+{
+    Shard& shard = shards[hash % SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto [first, last] = shard.ids.equal_range(hash);
+    for (auto existing = first; existing != last; ++existing)
+    {
+        if (std::memcmp(get(existing->second), block, blockSize) == 0)
+        {
+            return existing->second;
+        }
+    }
+
+    uint32_t id = count.fetch_add(1, std::memory_order_relaxed);
+    size_t slab = id / SLAB_BLOCKS;
+    if (slab >= MAX_SLABS)
+    {
+        throw std::length_error("BlockStore is full");
+    }
+    uint8_t* slabMemory = slabs[slab].load(std::memory_order_acquire);
+    if (slabMemory == nullptr)
+    {
+        std::lock_guard<std::mutex> slabLock(slabMutex);
+        slabMemory = slabs[slab].load(std::memory_order_relaxed);
+        if (slabMemory == nullptr)
+        {
+            slabMemory = new uint8_t[SLAB_BLOCKS * blockSize];
+            slabs[slab].store(slabMemory, std::memory_order_release);
+        }
+    }
+    std::memcpy(slabMemory + (id % SLAB_BLOCKS) * blockSize, block, blockSize);
+    shard.ids.emplace(hash, id);
+    return id;
+}
+
+m6502::ConcurrentHashSet::ConcurrentHashSet()
+    : shards(new Shard[SHARDS])
+{
+}
+
+bool m6502::ConcurrentHashSet::insert(uint64_t key)
+{
+    key = key != 0 ? key : 1;
+    // the top bits pick the shard, the low ones the slot
+    Shard& shard = shards[key >> 58];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if ((shard.used + 1) * 2 > shard.slots.size())
+    {
+        std::vector<uint64_t> old = std::move(shard.slots);
+        shard.slots.assign(std::max<size_t>(1024, old.size() * 2), 0);
+        const size_t mask = shard.slots.size() - 1;
+        for (uint64_t existing : old)
+        {
+            if (existing != 0)
+            {
+                size_t slot = existing & mask;
+                while (shard.slots[slot] != 0)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                shard.slots[slot] = existing;
+            }
+        }
+    }
+
+    const size_t mask = shard.slots.size() - 1;
+    for (size_t slot = key & mask;; slot = (slot + 1) & mask)
+    {
+        if (shard.slots[slot] == key)
+        {
+            return false;
+        }
+        if (shard.slots[slot] == 0)
+        {
+            shard.slots[slot] = key;
+            shard.used++;
+            count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
+
+// one per worker thread: a machine to run branches on, and the input source that makes its reads branch points
+template <typename CPUType>
+class m6502::Explorer<CPUType>::Worker : public InputSource
+{
+public:
+    explicit Worker(Explorer& explorer)
+        : explorer(explorer), memory(std::make_unique<Mem>()), cpu(explorer.initialCpu)
+    {
+        // the caller's devices stay with the caller, the workers would call them from several threads at once
+        cpu.inputSource = this;
+        cpu.inputPages = explorer.config.inputPages;
+        cpu.outputSink = nullptr;
+        cpu.outputPages = {};
+        cpu.fusionStats = nullptr;
+        loadedPages.fill(INVALID_ID);
+        loadedChunks.fill(INVALID_ID);
+    }
+
+    // the pending value answers the read of the fork being run. any other read is a new branch point: it gets a 0
+    // and the run stops after the instruction, to be rolled back to its start
+    uint8_t read(uint16_t address, uint64_t) override
+    {
+        if (hasPending && !consumed)
+        {
+            consumed = true;
+            return pending;
+        }
+        if (!blocked)
+        {
+            blocked = true;
+            blockedAddress = address;
+            blockedByte = memory->mem[address]; // a read-modify-write stores over it
+        }
+        return 0;
+    }
+
+    /** snapshots a machine given from outside */
+    Snapshot load(const CPUType& from, const Mem& fromMemory)
+    {
+        memory->mem = fromMemory.mem;
+        memory->mark_all_dirty();
+        cpu.PC = from.PC;
+        cpu.SP = from.SP;
+        cpu.A = from.A;
+        cpu.X = from.X;
+        cpu.Y = from.Y;
+        cpu.set_status(from.get_status(false));
+        return capture();
+    }
+
+    /** runs the values [first, first + count) of fork, each to its next branch point or its end. the forks they
+     *  reach go to children, the counts to counts */
+    void run(const Fork& fork, uint32_t first, uint32_t count, std::vector<Fork>& children, ExploreStats& counts)
+    {
+        const ExploreConfig& config = explorer.config;
+        bool halted = false;
+        uint32_t newCoverage = 0;
+        auto stop = [&](const CPUType& cpu, const Mem& memory) {
+            if (blocked || (hasPending && consumed))
+            {
+                return true;
+            }
+            if (explorer.isTrap[cpu.PC] || (config.haltOnBrk && memory[cpu.PC] == 0x00))
+            {
+                halted = true;
+                return true;
+            }
+            std::atomic<uint64_t>& word = explorer.coverage[cpu.PC / 64];
+            const uint64_t bit = 1ull << (cpu.PC % 64);
+            if ((word.load(std::memory_order_relaxed) & bit) == 0 && (word.fetch_or(bit, std::memory_order_relaxed) & bit) == 0)
+            {
+                newCoverage++;
+                explorer.coveredInstructions.fetch_add(1, std::memory_order_relaxed);
+            }
+            before = { cpu.cycleCount, cpu.PC, cpu.SP, cpu.A, cpu.X, cpu.Y, cpu.get_status(false) };
+            return false;
+        };
+        // @return false if the cycle limit ran out first
+        auto run_segment = [&]() {
+            for (int64_t budget = config.maxCyclesPerSegment; budget > 0;)
+            {
+                int32_t cycles = cpu.execute_until(static_cast<int32_t>(std::min<int64_t>(budget, 1 << 24)), *memory, stop);
+                budget -= cycles;
+                counts.cycles += cycles;
+                if (blocked || halted || (hasPending && consumed))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        for (uint32_t choice = first; choice < first + count; choice++)
+        {
+            counts.runs++;
+            restore(fork.snapshot);
+            hasPending = consumed = blocked = halted = false;
+            newCoverage = 0;
+
+            std::shared_ptr<const InputTrace> trace = fork.trace;
+            if (fork.hasInput)
+            {
+                // just the reading instruction, with this value
+                const uint8_t value = fork.choices ? (*fork.choices)[choice] : static_cast<uint8_t>(choice);
+                hasPending = true;
+                pending = value;
+                run_segment();
+                hasPending = false;
+                if (!consumed)
+                {
+                    throw std::logic_error("Explorer: a fork's instruction didn't read its input");
+                }
+                if (!explorer.visited.insert(explorer.hash_snapshot(capture())))
+                {
+                    counts.duplicates++;
+                    continue;
+                }
+                trace = std::make_shared<const InputTrace>(InputTrace{ fork.trace, fork.address, value });
+            }
+
+            if (!run_segment())
+            {
+                counts.timedOut++;
+                continue;
+            }
+            if (halted)
+            {
+                counts.halted++;
+                if (explorer.isTrap[cpu.PC])
+                {
+                    ExploreFinding finding{ cpu.PC, {} };
+                    for (const InputTrace* input = trace.get(); input != nullptr; input = input->parent.get())
+                    {
+                        finding.inputs.emplace_back(input->address, input->value);
+                    }
+                    std::reverse(finding.inputs.begin(), finding.inputs.end());
+                    counts.findings.push_back(std::move(finding));
+                }
+                continue;
+            }
+
+            // blocked on a read: roll its instruction back, and the state at its start is the new fork. the fork's
+            // runs count the instruction's cycles again, with the values they give it
+            counts.cycles -= cpu.cycleCount - before.cycle;
+            cpu.PC = before.PC;
+            cpu.SP = before.SP;
+            cpu.A = before.A;
+            cpu.X = before.X;
+            cpu.Y = before.Y;
+            cpu.set_status(before.P);
+            memory->mem[blockedAddress] = blockedByte;
+
+            std::shared_ptr<const std::vector<uint8_t>> choices;
+            if (config.inputChoices)
+            {
+                choices = std::make_shared<const std::vector<uint8_t>>(config.inputChoices(blockedAddress));
+                if (choices->empty())
+                {
+                    continue; // no value is allowed, the branch ends here
+                }
+            }
+            const uint32_t choiceCount = choices ? static_cast<uint32_t>(choices->size()) : 256;
+            children.push_back(Fork{ capture(), std::move(trace), std::move(choices), true, blockedAddress, 0, choiceCount,
+                                     newCoverage, fork.depth + 1, 0 });
+        }
+    }
+
+private:
+    /** brings the machine to a snapshot, copying only the pages that differ from what is loaded */
+    void restore(const Snapshot& snapshot)
+    {
+        // pages written since the last capture no longer match their ids
+        Mem::DirtyPages dirty = memory->take_dirty_pages();
+        for (size_t page = 0; page < Mem::PAGE_COUNT; page++)
+        {
+            if ((dirty[page / 64] >> (page % 64)) & 1)
+            {
+                loadedPages[page] = INVALID_ID;
+                loadedChunks[page / CHUNK_PAGES] = INVALID_ID;
+            }
+        }
+
+        for (size_t chunk = 0; chunk < CHUNK_COUNT; chunk++)
+        {
+            if (loadedChunks[chunk] == snapshot.chunks[chunk])
+            {
+                continue;
+            }
+            uint32_t pageIds[CHUNK_PAGES];
+            std::memcpy(pageIds, explorer.chunkStore.get(snapshot.chunks[chunk]), sizeof(pageIds));
+            for (size_t i = 0; i < CHUNK_PAGES; i++)
+            {
+                size_t page = chunk * CHUNK_PAGES + i;
+                if (loadedPages[page] != pageIds[i])
+                {
+                    std::memcpy(memory->mem.data() + page * Mem::PAGE_SIZE, explorer.pageStore.get(pageIds[i]), Mem::PAGE_SIZE);
+                    loadedPages[page] = pageIds[i];
+                }
+            }
+            loadedChunks[chunk] = snapshot.chunks[chunk];
+        }
+
+        cpu.PC = snapshot.PC;
+        cpu.SP = snapshot.SP;
+        cpu.A = snapshot.A;
+        cpu.X = snapshot.X;
+        cpu.Y = snapshot.Y;
+        cpu.set_status(snapshot.P);
+    }
+
+    /** interns the pages written since the last restore or capture, and the chunk tables they're in */
+    Snapshot capture()
+    {
+        Mem::DirtyPages dirty = memory->take_dirty_pages();
+        for (size_t page = 0; page < Mem::PAGE_COUNT; page++)
+        {
+            if ((dirty[page / 64] >> (page % 64)) & 1)
+            {
+                const uint8_t* data = memory->mem.data() + page * Mem::PAGE_SIZE;
+                uint32_t id = explorer.pageStore.intern(data, hash_page(data, 0));
+                if (id != loadedPages[page])
+                {
+                    loadedPages[page] = id;
+                    loadedChunks[page / CHUNK_PAGES] = INVALID_ID;
+                }
+            }
+        }
+
+        Snapshot snapshot;
+        for (size_t chunk = 0; chunk < CHUNK_COUNT; chunk++)
+        {
+            if (loadedChunks[chunk] == INVALID_ID)
+            {
+                const uint32_t* pageIds = loadedPages.data() + chunk * CHUNK_PAGES;
+                loadedChunks[chunk] = explorer.chunkStore.intern(reinterpret_cast<const uint8_t*>(pageIds), hash_ids(pageIds, CHUNK_PAGES, chunk));
+            }
+            snapshot.chunks[chunk] = loadedChunks[chunk];
+        }
+        snapshot.PC = cpu.PC;
+        snapshot.SP = cpu.SP;
+        snapshot.A = cpu.A;
+        snapshot.X = cpu.X;
+        snapshot.Y = cpu.Y;
+        snapshot.P = cpu.get_status(false);
+        return snapshot;
+    }
+
+    Explorer& explorer;
+    std::unique_ptr<Mem> memory;
+    CPUType cpu;
+    // the ids of what is in memory, INVALID_ID where that isn't known
+    std::array<uint32_t, Mem::PAGE_COUNT> loadedPages;
+    std::array<uint32_t, CHUNK_COUNT> loadedChunks;
+
+    bool hasPending = false;
+    uint8_t pending = 0;
+    bool consumed = false;
+    bool blocked = false;
+    uint16_t blockedAddress = 0;
+    uint8_t blockedByte = 0;
+    // the cycle and the registers at the start of the instruction about to run, to roll a read back to
+    struct
+    {
+        uint64_t cycle;
+        uint16_t PC;
+        uint8_t SP, A, X, Y, P;
+    } before{};
+};
+
+template <typename CPUType>
+bool m6502::Explorer<CPUType>::ForkOrder::operator()(const Fork& a, const Fork& b) const
+{
+    // true if a runs after b: more new coverage first, then shallower, then older
+    if (a.newCoverage != b.newCoverage)
+    {
+        return a.newCoverage < b.newCoverage;
+    }
+    if (a.depth != b.depth)
+    {
+        return a.depth > b.depth;
+    }
+    return a.order > b.order;
+}
+
+template <typename CPUType>
+m6502::Explorer<CPUType>::Explorer(ExploreConfig config)
+    : config(std::move(config)), pageStore(Mem::PAGE_SIZE), chunkStore(CHUNK_PAGES * sizeof(uint32_t)),
+      isTrap(Mem::MEM_SIZE), coverage(new std::atomic<uint64_t>[Mem::MEM_SIZE / 64]())
+{
+    for (uint16_t trap : this->config.traps)
+    {
+        isTrap[trap] = true;
+    }
+}
+
+template <typename CPUType>
+m6502::Explorer<CPUType>::~Explorer() = default;
+
+template <typename CPUType>
+uint64_t m6502::Explorer<CPUType>::hash_snapshot(const Snapshot& snapshot) const
+{
+    uint64_t registers = snapshot.PC | ((uint64_t)snapshot.SP << 16) | ((uint64_t)snapshot.A << 24) | ((uint64_t)snapshot.X << 32)
+        | ((uint64_t)snapshot.Y << 40) | ((uint64_t)snapshot.P << 48);
+    return hash_ids(snapshot.chunks.data(), CHUNK_COUNT, registers);
+}
+
+template <typename CPUType>
+void m6502::Explorer<CPUType>::work()
+{
+    std::unique_ptr<Worker> worker;
+    std::vector<Fork> children;
+    ExploreStats counts;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wakeUp.wait(lock, [&]() { return stopped || !frontier.empty() || activeWorkers == 0; });
+        if (stopped || frontier.empty())
+        {
+            break; // the search is over, or nothing is left and nobody can add more
+        }
+        // claim a batch of the best fork's values. its place in the heap doesn't depend on them
+        Fork& best = frontier.front();
+        const uint32_t first = best.nextChoice;
+        const uint32_t count = std::min(CHOICE_BATCH, best.choiceCount - first);
+        best.nextChoice += count;
+        Fork fork;
+        if (best.nextChoice == best.choiceCount)
+        {
+            std::pop_heap(frontier.begin(), frontier.end(), ForkOrder());
+            fork = std::move(frontier.back());
+            frontier.pop_back();
+        }
+        else
+        {
+            fork = best;
+        }
+        activeWorkers++;
+        lock.unlock();
+
+        children.clear();
+        counts = {};
+        try
+        {
+            if (!worker)
+            {
+                worker = std::make_unique<Worker>(*this);
+            }
+            worker->run(fork, first, count, children, counts);
+        }
+        catch (...)
+        {
+            lock.lock();
+            error = std::current_exception();
+            stopped = true;
+            activeWorkers--;
+            break;
+        }
+
+        lock.lock();
+        activeWorkers--;
+        stats.duplicates += counts.duplicates;
+        stats.runs += counts.runs;
+        stats.halted += counts.halted;
+        stats.timedOut += counts.timedOut;
+        stats.cycles += counts.cycles;
+        for (ExploreFinding& finding : counts.findings)
+        {
+            stats.findings.push_back(std::move(finding));
+        }
+        for (Fork& child : children)
+        {
+            child.order = nextOrder++;
+            frontier.push_back(std::move(child));
+            std::push_heap(frontier.begin(), frontier.end(), ForkOrder());
+        }
+        stats.maxFrontier = std::max(stats.maxFrontier, frontier.size());
+        if (visited.size() >= config.maxStates)
+        {
+            stopped = true;
+        }
+        wakeUp.notify_all();
+    }
+    wakeUp.notify_all();
+}
+
+template <typename CPUType>
+m6502::ExploreStats m6502::Explorer<CPUType>::run(const CPUType& cpu, const Mem& memory)
+{
+    auto start = std::chrono::steady_clock::now();
+    initialCpu = cpu;
+
+    {
+        Worker rootWorker(*this);
+        Fork root{ rootWorker.load(cpu, memory), nullptr, nullptr, false, 0, 0, 1, 0, 0, nextOrder++ };
+        visited.insert(hash_snapshot(root.snapshot));
+        frontier.push_back(std::move(root));
+    }
+
+    size_t threadCount = config.threads != 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        workers.emplace_back([this]() { work(); });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    stats.complete = !stopped && frontier.empty();
+    stats.states = visited.size();
+    stats.coveredInstructions = coveredInstructions.load();
+    stats.pages = pageStore.size();
+    stats.chunks = chunkStore.size();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+template class m6502::Explorer<m6502::CPU>;
+template class m6502::Explorer<m6502::CPUIllegal>;
+template class m6502::Explorer<m6502::CPU65C02>;
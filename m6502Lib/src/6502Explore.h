@@ -0,0 +1,232 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "6502.h"
+#include "6502Replay.h"
+
+// State space exploration over input choices, for checking firmware against every input sequence.
+//
+// Reads of the input pages are the branch points: a machine that reads input forks into one branch per allowed
+// value. When a run reaches a read it rolls the reading instruction back and snapshots the machine at the start of
+// it, so a fork is that snapshot plus the values still to try; the frontier holds one entry per fork, not per value.
+// A worker claims a batch of a fork's values, and for each one restores the snapshot, runs just the reading
+// instruction with that value and snapshots the state after it. States already seen (registers and memory, by hash)
+// are dropped, the rest run on until their next input read, a halt (BRK or a trap address) or the cycle limit.
+// Traps are reported together with the inputs that led there.
+//
+// Snapshots share everything they have in common. Pages are interned by content in a BlockStore, and so are the
+// tables of page ids for each 16 page chunk, so a snapshot is the registers and 16 chunk ids, and forking costs
+// only the pages a branch actually writes (found through Mem's dirty marks). The visited set keeps 64 bit hashes.
+//
+// The frontier is a priority queue of forks ordered by how many new instructions (by address) the run that reached
+// them covered, then by depth, so branches that discover code run first. Workers run on all cores by default.
+
+namespace m6502
+{
+    /** a content addressed store of fixed size blocks. equal blocks get the same id, ids count up from 0 and blocks never move */
+    class BlockStore;
+    /** a set of 64 bit keys, open addressing with one lock per shard */
+    class ConcurrentHashSet;
+
+    struct ExploreConfig
+    {
+        // reads of these pages are input points
+        std::array<bool, Mem::PAGE_COUNT> inputPages{};
+        // the values a read of address may return. unset means all 256
+        std::function<std::vector<uint8_t>(uint16_t address)> inputChoices;
+        // reaching one of these is a finding and ends the branch
+        std::vector<uint16_t> traps;
+        // a BRK about to execute ends the branch
+        bool haltOnBrk = true;
+        // cycles a branch may run without reading input before it is given up
+        int64_t maxCyclesPerSegment = 1'000'000;
+        // stop after this many distinct states
+        size_t maxStates = 10'000'000;
+        // 0 for all cores
+        size_t threads = 0;
+    };
+
+    struct ExploreFinding
+    {
+        uint16_t PC;
+        // every input read on the way, in order
+        std::vector<std::pair<uint16_t, uint8_t>> inputs;
+    };
+
+    struct ExploreStats
+    {
+        size_t states = 0;      // distinct states, the initial one included
+        size_t duplicates = 0;  // branches that ended up in a state seen before
+        size_t runs = 0;        // one per input value tried, and one for the initial state
+        size_t halted = 0;      // branches ended by a BRK or a trap
+        size_t timedOut = 0;    // branches that hit maxCyclesPerSegment
+        size_t coveredInstructions = 0; // distinct addresses an instruction was executed from
+        uint64_t cycles = 0;    // emulated over all runs
+        size_t pages = 0;       // distinct pages stored
+        size_t chunks = 0;      // distinct chunk tables stored
+        size_t maxFrontier = 0; // in forks
+        bool complete = false;  // every branch was explored, maxStates wasn't reached
+        double seconds = 0.0;
+        std::vector<ExploreFinding> findings;
+    };
+
+    template <typename CPUType> class Explorer;
+}
+
+class m6502::BlockStore
+{
+public:
+    explicit BlockStore(size_t blockSize);
+    ~BlockStore();
+
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    /** @return the id of the block with these contents, storing it if it is new. hash is any hash of the contents */
+    uint32_t intern(const uint8_t* block, uint64_t hash);
+    /** the contents of a block. safe from any thread that got the id from intern() or from another thread */
+    const uint8_t* get(uint32_t id) const
+    {
+        return slabs[id / SLAB_BLOCKS].load(std::memory_order_acquire) + (size_t)(id % SLAB_BLOCKS) * blockSize;
+    }
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t SHARDS = 64;
+    static constexpr size_t SLAB_BLOCKS = 4096;
+    static constexpr size_t MAX_SLABS = 65536;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_multimap<uint64_t, uint32_t> ids; // hash -> ids of the blocks with that hash
+    };
+
+    const size_t blockSize;
+    std::unique_ptr<Shard[]> shards;
+    // blocks are allocated in slabs that are never freed or moved, so get() needs no lock
+    std::unique_ptr<std::atomic<uint8_t*>[]> slabs;
+    std::mutex slabMutex;
+    std::atomic<uint32_t> count = 0;
+};
+
+class m6502::ConcurrentHashSet
+{
+public:
+    ConcurrentHashSet();
+
+    /** @return true if key wasn't in the set yet */
+    bool insert(uint64_t key);
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t SHARDS = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<uint64_t> slots; // 0 marks an empty slot
+        size_t used = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<size_t> count = 0;
+};
+
+template <typename CPUType>
+class m6502::Explorer
+{
+public:
+    explicit Explorer(ExploreConfig config);
+    ~Explorer();
+
+    /** explores every input sequence from this machine. the input pages of cpu are replaced by the config's */
+    ExploreStats run(const CPUType& cpu, const Mem& memory);
+
+private:
+    static constexpr size_t CHUNK_PAGES = 16;
+    static constexpr size_t CHUNK_COUNT = Mem::PAGE_COUNT / CHUNK_PAGES;
+
+    struct Snapshot
+    {
+        uint16_t PC;
+        uint8_t SP, A, X, Y, P;
+        std::array<uint32_t, CHUNK_COUNT> chunks;
+    };
+
+    // the inputs that led to a state, shared by all the states after it. only made for states that aren't duplicates
+    struct InputTrace
+    {
+        std::shared_ptr<const InputTrace> parent;
+        uint16_t address;
+        uint8_t value;
+    };
+
+    // a state to run from: the initial one, or a branch point with the input values still to try
+    struct Fork
+    {
+        Snapshot snapshot; // at the start of the instruction reading input, or the initial state
+        std::shared_ptr<const InputTrace> trace; // the inputs read before it
+        std::shared_ptr<const std::vector<uint8_t>> choices; // the values to try, null for all 256
+        bool hasInput;     // false for the initial state, which is run once as it is
+        uint16_t address;  // of the read
+        uint32_t nextChoice;
+        uint32_t choiceCount;
+        uint32_t newCoverage; // found by the run that reached the fork
+        uint32_t depth;
+        uint64_t order;
+    };
+
+    struct ForkOrder
+    {
+        bool operator()(const Fork& a, const Fork& b) const;
+    };
+
+    // values a worker claims from a fork at a time. smaller spreads a fork over more workers, larger locks less
+    static constexpr uint32_t CHOICE_BATCH = 16;
+
+    class Worker;
+
+    uint64_t hash_snapshot(const Snapshot& snapshot) const;
+    /** a worker thread: claims values of the best fork on the frontier and pushes the forks its runs reach */
+    void work();
+
+    ExploreConfig config;
+    BlockStore pageStore;
+    BlockStore chunkStore;
+    ConcurrentHashSet visited;
+    std::vector<bool> isTrap;
+    // an address bit is set once an instruction has been executed from it
+    std::unique_ptr<std::atomic<uint64_t>[]> coverage;
+    std::atomic<size_t> coveredInstructions = 0;
+    CPUType initialCpu;
+
+    std::mutex mutex; // guards everything below
+    std::condition_variable wakeUp;
+    std::vector<Fork> frontier; // a heap ordered by ForkOrder
+    size_t activeWorkers = 0;
+    uint64_t nextOrder = 0;
+    bool stopped = false;
+    std::exception_ptr error; // from a worker, rethrown by run()
+    ExploreStats stats;
+};
+
+namespace m6502
+{
+    // instantiated once in 6502Explore.cpp
+    extern template class Explorer<CPU>;
+    extern template class Explorer<CPUIllegal>;
+    extern template class Explorer<CPU65C02>;
+}
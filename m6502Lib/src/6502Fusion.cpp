@@ -0,0 +1,34 @@
+﻿#include "6502Fusion.h"
+
+#include <algorithm>
+#include <vector>
+
+void m6502::FusionStats::report(std::ostream& out, const OpcodeTable& opcodes, size_t topPairs) const
+{
+    out << "fused sequences:\n";
+    for (size_t pattern = 0; pattern < FUSION_PATTERNS.size(); pattern++)
+    {
+        out << "  " << FUSION_PATTERNS[pattern].name << ": " << fired[pattern] << "\n";
+    }
+
+    std::vector<uint32_t> pairs;
+    for (uint32_t pair = 0; pair < dispatchedPairs.size(); pair++)
+    {
+        if (dispatchedPairs[pair] != 0)
+        {
+            pairs.push_back(pair);
+        }
+    }
+    topPairs = std::min(topPairs, pairs.size());
+    std::partial_sort(pairs.begin(), pairs.begin() + topPairs, pairs.end(),
+                      [&](uint32_t lhs, uint32_t rhs) { return dispatchedPairs[lhs] > dispatchedPairs[rhs]; });
+
+    out << "most frequent unfused pairs:\n";
+    for (size_t i = 0; i < topPairs; i++)
+    {
+        uint8_t first = pairs[i] >> 8, second = pairs[i] & 0xFF;
+        out << "  " << mnemonic_name(opcodes[first].mnemonic) << " ($" << std::hex << (int)first << "); "
+            << mnemonic_name(opcodes[second].mnemonic) << " ($" << (int)second << std::dec << "): "
+            << dispatchedPairs[pairs[i]] << "\n";
+    }
+}
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "6502Variants.h"
+
+// Superinstructions. The handler of a pattern's first opcode peeks at the following opcodes and, when they match,
+// executes them inline instead of going back through the dispatch table. Each step is the regular opcode handler
+// and only runs if the cycle budget would have let execute() reach it, so results and cycle counts are identical
+// with fusion on or off. Memory is re-read every time, so self modifying code is never a problem.
+
+namespace m6502
+{
+    struct FusionPattern
+    {
+        const char* name;
+        uint8_t length;
+        std::array<uint8_t, 3> opcodes;
+    };
+
+    // the hot sequences of our firmware. a first opcode may only lead one pattern
+    inline constexpr std::array<FusionPattern, 9> FUSION_PATTERNS = {{
+        {"DEX; BNE",                2, {0xCA, 0xD0}},
+        {"DEY; BNE",                2, {0x88, 0xD0}},
+        {"INX; CPX #; BNE",         3, {0xE8, 0xE0, 0xD0}},
+        {"INY; CPY #; BNE",         3, {0xC8, 0xC0, 0xD0}},
+        {"LDA zp; STA zp",          2, {0xA5, 0x85}},
+        {"LDA abs; STA abs",        2, {0xAD, 0x8D}},
+        {"LDA abs,X; STA abs,X",    2, {0xBD, 0x9D}},
+        {"LDA abs,Y; STA abs,Y",    2, {0xB9, 0x99}},
+        {"LDA (zp),Y; STA (zp),Y",  2, {0xB1, 0x91}},
+    }};
+
+    inline constexpr size_t NO_FUSION = FUSION_PATTERNS.size();
+
+    // index of the pattern led by opcode, or NO_FUSION
+    constexpr size_t fusion_pattern_for(uint8_t opcode)
+    {
+        for (size_t pattern = 0; pattern < FUSION_PATTERNS.size(); pattern++)
+        {
+            if (FUSION_PATTERNS[pattern].opcodes[0] == opcode)
+            {
+                return pattern;
+            }
+        }
+        return NO_FUSION;
+    }
+
+    constexpr bool fusion_leads_are_unique()
+    {
+        for (size_t pattern = 0; pattern < FUSION_PATTERNS.size(); pattern++)
+        {
+            if (fusion_pattern_for(FUSION_PATTERNS[pattern].opcodes[0]) != pattern)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(fusion_leads_are_unique(), "a first opcode may only lead one pattern");
+
+    // filled by execute() while a CPU's fusionStats points at it
+    struct FusionStats
+    {
+        // complete fused sequences, per FUSION_PATTERNS entry
+        std::array<uint64_t, FUSION_PATTERNS.size()> fired{};
+        // (opcode << 8 | next opcode) pairs that ran back to back with the second one still going through the dispatch
+        // table. the first is whatever ran last, a fused sequence's last step included. the top ones are the next fusion candidates
+        std::array<uint64_t, 256 * 256> dispatchedPairs{};
+
+        void clear()
+        {
+            fired.fill(0);
+            dispatchedPairs.fill(0);
+        }
+
+        /** prints the fired patterns and the most frequent unfused pairs, named after the variant's opcodes */
+        void report(std::ostream& out, const OpcodeTable& opcodes, size_t topPairs = 10) const;
+    };
+}
@@ -0,0 +1,196 @@
+﻿#include "6502.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+m6502::Mem::DirtyPages m6502::Mem::take_dirty_pages()
+{
+    DirtyPages dirty = dirtyPages;
+    dirtyPages = {};
+    if (std::any_of(dirty.begin(), dirty.end(), [](uint64_t bits) { return bits != 0; }))
+    {
+        dirtyVersion++;
+        for (size_t word = 0; word < dirty.size(); word++)
+        {
+            for (uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+            {
+                pageVersions[word * 64 + std::countr_zero(bits)] = dirtyVersion;
+            }
+        }
+    }
+    return dirty;
+}
+
+m6502::Mem::DirtyPages m6502::Mem::dirty_pages_since(uint64_t& version)
+{
+    take_dirty_pages();
+    DirtyPages dirty{};
+    for (size_t page = 0; page < PAGE_COUNT; page++)
+    {
+        if (pageVersions[page] > version)
+        {
+            dirty[page / 64] |= 1ull << (page % 64);
+        }
+    }
+    version = dirtyVersion;
+    return dirty;
+}
+
+// the block transfers of Mem. each one walks its range in linear spans that stop at $FFFF
+
+void m6502::Mem::mark_dirty_range(uint16_t address, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+    if (length >= MEM_SIZE)
+    {
+        mark_all_dirty();
+        return;
+    }
+    size_t firstPage = address / PAGE_SIZE;
+    size_t pages = (address % PAGE_SIZE + length + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (size_t page = 0; page < pages; page++)
+    {
+        size_t wrapped = (firstPage + page) % PAGE_COUNT;
+        dirtyPages[wrapped / 64] |= 1ull << (wrapped % 64);
+    }
+}
+
+void m6502::Mem::load_block(uint16_t address, const uint8_t* data, size_t length)
+{
+    length = std::min(length, MEM_SIZE);
+    mark_dirty_range(address, length);
+    size_t offset = address;
+    while (length > 0)
+    {
+        size_t span = std::min(length, MEM_SIZE - offset);
+        std::memcpy(mem.data() + offset, data, span);
+        data += span;
+        length -= span;
+        offset = 0;
+    }
+}
+
+void m6502::Mem::read_block(uint16_t address, uint8_t* data, size_t length) const
+{
+    length = std::min(length, MEM_SIZE);
+    size_t offset = address;
+    while (length > 0)
+    {
+        size_t span = std::min(length, MEM_SIZE - offset);
+        std::memcpy(data, mem.data() + offset, span);
+        data += span;
+        length -= span;
+        offset = 0;
+    }
+}
+
+void m6502::Mem::copy_block(uint16_t destination, uint16_t source, size_t length)
+{
+    length = std::min(length, MEM_SIZE);
+    if (length == 0 || destination == source)
+    {
+        return;
+    }
+
+    const bool sourceWraps = source + length > MEM_SIZE;
+    const bool destinationWraps = destination + length > MEM_SIZE;
+    if (!sourceWraps && !destinationWraps)
+    {
+        // the common case, one memmove takes care of any overlap
+        mark_dirty_range(destination, length);
+        std::memmove(mem.data() + destination, mem.data() + source, length);
+        return;
+    }
+
+    const size_t distance = (destination - source) & 0xFFFF;
+    if (distance >= length && MEM_SIZE - distance >= length)
+    {
+        // no overlap, so the spans can go in any order
+        mark_dirty_range(destination, length);
+        size_t from = source, to = destination;
+        while (length > 0)
+        {
+            size_t span = std::min({ length, MEM_SIZE - from, MEM_SIZE - to });
+            std::memcpy(mem.data() + to, mem.data() + from, span);
+            from = (from + span) % MEM_SIZE;
+            to = (to + span) % MEM_SIZE;
+            length -= span;
+        }
+        return;
+    }
+
+    // overlapping and wrapping. rare enough to go through a copy
+    std::vector<uint8_t> block(length);
+    read_block(source, block.data(), length);
+    load_block(destination, block.data(), length);
+}
+
+void m6502::Mem::fill(uint16_t address, uint8_t value, size_t length)
+{
+    length = std::min(length, MEM_SIZE);
+    mark_dirty_range(address, length);
+    size_t offset = address;
+    while (length > 0)
+    {
+        size_t span = std::min(length, MEM_SIZE - offset);
+        std::memset(mem.data() + offset, value, span);
+        length -= span;
+        offset = 0;
+    }
+}
+
+int m6502::Mem::compare(uint16_t address, const uint8_t* data, size_t length) const
+{
+    size_t offset = address;
+    while (length > 0)
+    {
+        size_t span = std::min(length, MEM_SIZE - offset);
+        if (int result = std::memcmp(mem.data() + offset, data, span); result != 0)
+        {
+            return result;
+        }
+        data += span;
+        length -= span;
+        offset = 0;
+    }
+    return 0;
+}
+
+int32_t m6502::Mem::find_pattern(const uint8_t* pattern, size_t length, uint16_t start, size_t range) const
+{
+    range = std::min(range, MEM_SIZE);
+    if (length == 0)
+    {
+        return start;
+    }
+    if (length > range)
+    {
+        return -1;
+    }
+
+    // memchr finds the candidates for the first byte, compare() checks the rest, wrapping if it has to
+    size_t candidates = range - length + 1;
+    size_t offset = start;
+    while (candidates > 0)
+    {
+        size_t span = std::min(candidates, MEM_SIZE - offset);
+        const uint8_t* begin = mem.data() + offset;
+        const uint8_t* end = begin + span;
+        for (const uint8_t* hit = begin; (hit = static_cast<const uint8_t*>(std::memchr(hit, pattern[0], end - hit))) != nullptr; hit++)
+        {
+            uint16_t address = static_cast<uint16_t>(hit - mem.data());
+            if (compare(static_cast<uint16_t>(address + 1), pattern + 1, length - 1) == 0)
+            {
+                return address;
+            }
+        }
+        candidates -= span;
+        offset = 0;
+    }
+    return -1;
+}
@@ -0,0 +1,137 @@
+﻿#include "6502Replay.h"
+
+#include <stdexcept>
+#include <string>
+
+m6502::InputRecorder::InputRecorder(InputSource& device, std::ostream& log)
+    : device(device), log(log)
+{
+    log.write(MAGIC, sizeof(MAGIC));
+    log.put(static_cast<char>(VERSION));
+    byteCount = sizeof(MAGIC) + 1;
+}
+
+uint8_t m6502::InputRecorder::read(uint16_t address, uint64_t cycle)
+{
+    uint8_t value = device.read(address, cycle);
+    write_event(InputEvent::Read, cycle, address, value);
+    return value;
+}
+
+void m6502::InputRecorder::write_event(InputEvent kind, uint64_t cycle, uint16_t address, uint8_t value)
+{
+    // one varint of up to 10 bytes, a 3 byte one for the address and the value
+    char buffer[14];
+    size_t length = 0;
+    auto put_varint = [&](uint64_t number) {
+        while (number >= 0x80)
+        {
+            buffer[length++] = static_cast<char>(number | 0x80);
+            number >>= 7;
+        }
+        buffer[length++] = static_cast<char>(number);
+    };
+
+    put_varint((cycle - lastCycle) << 2 | static_cast<uint8_t>(kind));
+    lastCycle = cycle;
+    if (kind == InputEvent::Read)
+    {
+        // zigzag, so stepping backwards through a device's registers stays small too
+        int32_t delta = static_cast<int16_t>(address - lastAddress);
+        put_varint(static_cast<uint32_t>((delta << 1) ^ (delta >> 31)));
+        buffer[length++] = static_cast<char>(value);
+        lastAddress = address;
+    }
+
+    log.write(buffer, length);
+    eventCount++;
+    byteCount += length;
+}
+
+m6502::InputPlayer::InputPlayer(std::istream& log)
+    : log(log)
+{
+    char header[sizeof(InputRecorder::MAGIC) + 1] = {};
+    log.read(header, sizeof(header));
+    if (!log || std::string(header, sizeof(InputRecorder::MAGIC)) != std::string(InputRecorder::MAGIC, sizeof(InputRecorder::MAGIC)))
+    {
+        throw std::runtime_error("not an input recording");
+    }
+    if (static_cast<uint8_t>(header[sizeof(InputRecorder::MAGIC)]) != InputRecorder::VERSION)
+    {
+        throw std::runtime_error("unsupported input recording version");
+    }
+    read_event();
+}
+
+bool m6502::InputPlayer::read_varint(uint64_t& number)
+{
+    number = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = log.get();
+        if (byte == std::char_traits<char>::eof())
+        {
+            return false;
+        }
+        number |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    throw std::runtime_error("bad varint in input recording");
+}
+
+void m6502::InputPlayer::read_event()
+{
+    hasNext = false;
+    if (log.peek() == std::char_traits<char>::eof())
+    {
+        return;
+    }
+
+    // an event cut short is where the recording ended, like a crash leaves it. the events before it all replay
+    uint64_t header;
+    if (!read_varint(header))
+    {
+        cutShort = true;
+        return;
+    }
+    nextKind = static_cast<InputEvent>(header & 3);
+    nextCycle += header >> 2;
+    if (nextKind == InputEvent::Read)
+    {
+        uint64_t zigzag;
+        int value = read_varint(zigzag) ? log.get() : std::char_traits<char>::eof();
+        if (value == std::char_traits<char>::eof())
+        {
+            cutShort = true;
+            return;
+        }
+        int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        nextAddress = static_cast<uint16_t>(nextAddress + delta);
+        nextValue = static_cast<uint8_t>(value);
+    }
+    else if (nextKind != InputEvent::Irq && nextKind != InputEvent::Nmi)
+    {
+        throw std::runtime_error("bad event in input recording");
+    }
+    hasNext = true;
+}
+
+uint8_t m6502::InputPlayer::read(uint16_t address, uint64_t cycle)
+{
+    if (!hasNext || nextKind != InputEvent::Read || nextCycle != cycle || nextAddress != address)
+    {
+        diverged("unexpected read", cycle);
+    }
+    uint8_t value = nextValue;
+    read_event();
+    return value;
+}
+
+void m6502::InputPlayer::diverged(const char* what, uint64_t cycle)
+{
+    throw std::runtime_error(std::string("replay diverged from the recording: ") + what + " at cycle " + std::to_string(cycle));
+}
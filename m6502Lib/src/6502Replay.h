@@ -0,0 +1,164 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "6502.h"
+
+// Deterministic record/replay of everything that comes from outside the machine.
+//
+// The emulator itself is deterministic, so a run is reproduced by its inputs: the values host devices returned for
+// reads of their pages (BasicCPU::inputPages), and the interrupts the host asserted, each at a CPU cycle.
+// InputRecorder sits between the CPU and the real devices, passing reads through and appending every event to a
+// log. InputPlayer stands in for the devices in a replay, answering reads from the log and asserting the interrupts
+// at the logged cycles, so a replay needs no devices at all.
+//
+// Log format: "65RL", a version byte, then the events. Each event starts with a LEB128 varint of
+// (cycles since the previous event) << 2 | kind. A read follows it with a zigzag varint of its address minus the
+// previous read's address, then the value. A device polled in a loop costs 3 bytes per read, an interrupt 1 or 2.
+// The log is only ever appended to, so one cut short by a crash replays up to its last complete event.
+
+namespace m6502
+{
+    /** a host device answering reads of its pages */
+    class InputSource
+    {
+    public:
+        virtual ~InputSource() = default;
+        /** @return the value on the bus for a read of address. cycle is BasicCPU::cycleCount as of the end of the read */
+        virtual uint8_t read(uint16_t address, uint64_t cycle) = 0;
+    };
+
+    enum class InputEvent : uint8_t
+    {
+        Read,
+        Irq,
+        Nmi,
+    };
+
+    class InputRecorder;
+    class InputPlayer;
+}
+
+class m6502::InputRecorder : public InputSource
+{
+public:
+    static constexpr char MAGIC[4] = { '6', '5', 'R', 'L' };
+    static constexpr uint8_t VERSION = 1;
+
+    /** device answers the reads. the header is written to log right away */
+    InputRecorder(InputSource& device, std::ostream& log);
+
+    uint8_t read(uint16_t address, uint64_t cycle) override;
+
+    /** asserts IRQ on cpu and logs it. the host raises its interrupts through these instead of the CPU's */
+    template <typename CPUType>
+    bool irq(CPUType& cpu, Mem& memory)
+    {
+        write_event(InputEvent::Irq, cpu.cycleCount, 0, 0);
+        return cpu.irq(memory);
+    }
+    template <typename CPUType>
+    void nmi(CPUType& cpu, Mem& memory)
+    {
+        write_event(InputEvent::Nmi, cpu.cycleCount, 0, 0);
+        cpu.nmi(memory);
+    }
+
+    size_t events() const { return eventCount; }
+    /** bytes logged, header included */
+    size_t bytes() const { return byteCount; }
+
+private:
+    void write_event(InputEvent kind, uint64_t cycle, uint16_t address, uint8_t value);
+
+    InputSource& device;
+    std::ostream& log;
+    uint64_t lastCycle = 0;
+    uint16_t lastAddress = 0;
+    size_t eventCount = 0;
+    size_t byteCount = 0;
+};
+
+class m6502::InputPlayer : public InputSource
+{
+public:
+    /** throws std::runtime_error if log isn't a recording */
+    explicit InputPlayer(std::istream& log);
+
+    /** answers a read from the log. throws std::runtime_error if the replay has diverged from the recording */
+    uint8_t read(uint16_t address, uint64_t cycle) override;
+
+    /** runs cpu for at least cycles (whole instructions), asserting the logged interrupts at their cycles.
+     *  set cpu.inputSource to the player and cpu.inputPages as in the recording first. @return the number of cycles it took */
+    template <typename CPUType>
+    int64_t run(CPUType& cpu, Mem& memory, int64_t cycles);
+
+    /** every event has been replayed */
+    bool finished() const { return !hasNext; }
+    /** the recording ends inside an event, which is left out of the replay */
+    bool cut_short() const { return cutShort; }
+
+private:
+    /** decodes the next event, if any. a partial event at the end of the log counts as the end */
+    void read_event();
+    /** @return false if the log ends first */
+    bool read_varint(uint64_t& number);
+    [[noreturn]] void diverged(const char* what, uint64_t cycle);
+
+    std::istream& log;
+    bool hasNext = false;
+    bool cutShort = false;
+    InputEvent nextKind = InputEvent::Read;
+    uint64_t nextCycle = 0;
+    uint16_t nextAddress = 0;
+    uint8_t nextValue = 0;
+};
+
+template <typename CPUType>
+int64_t m6502::InputPlayer::run(CPUType& cpu, Mem& memory, int64_t cycles)
+{
+    const uint64_t start = cpu.cycleCount;
+    const uint64_t end = start + cycles;
+    while (cpu.cycleCount < end)
+    {
+        // stop at the next event. interrupts were asserted between instructions, so the budget lands on them
+        // exactly. a read happens inside the instruction that ends at or after its cycle, and once it has been
+        // consumed the event after it is known
+        uint64_t until = end;
+        if (hasNext)
+        {
+            if (nextKind == InputEvent::Read && nextCycle <= cpu.cycleCount)
+            {
+                diverged("a logged read was skipped", nextCycle);
+            }
+            until = std::min(until, nextCycle);
+        }
+        if (until > cpu.cycleCount)
+        {
+            cpu.execute(static_cast<int32_t>(std::min<uint64_t>(until - cpu.cycleCount, INT32_MAX)), memory);
+        }
+
+        while (hasNext && nextKind != InputEvent::Read && nextCycle <= cpu.cycleCount)
+        {
+            if (nextCycle != cpu.cycleCount)
+            {
+                diverged("an interrupt fell inside an instruction", nextCycle);
+            }
+            InputEvent kind = nextKind;
+            read_event();
+            if (kind == InputEvent::Irq)
+            {
+                cpu.irq(memory);
+            }
+            else
+            {
+                cpu.nmi(memory);
+            }
+        }
+    }
+    return cpu.cycleCount - start;
+}
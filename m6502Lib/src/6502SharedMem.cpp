@@ -0,0 +1,196 @@
+﻿#include "6502SharedMem.h"
+
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// readers only map the bytes, the dirty page bits that follow them are the writer's
+static_assert(offsetof(m6502::Mem, mem) == 0, "readers treat the image as raw bytes");
+
+#if defined(__linux__)
+
+m6502::SharedMem::SharedMem(const char* name)
+{
+    memFd = memfd_create(name, MFD_CLOEXEC);
+    if (memFd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "memfd_create");
+    }
+
+    mappingSize = SharedMemHeader::IMAGE_OFFSET + sizeof(Mem);
+    if (ftruncate(memFd, mappingSize) != 0)
+    {
+        int error = errno;
+        close(memFd);
+        throw std::system_error(error, std::generic_category(), "ftruncate");
+    }
+    mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        int error = errno;
+        close(memFd);
+        throw std::system_error(error, std::generic_category(), "mmap");
+    }
+
+    header = new (mapping) SharedMemHeader{};
+    header->magic = SharedMemHeader::MAGIC;
+    header->version = SharedMemHeader::VERSION;
+    memory = new (static_cast<uint8_t*>(mapping) + SharedMemHeader::IMAGE_OFFSET) Mem;
+    memory->initialize();
+}
+
+m6502::SharedMem::~SharedMem()
+{
+    munmap(mapping, mappingSize);
+    close(memFd);
+}
+
+void m6502::SharedMem::begin_update()
+{
+    uint64_t generation = header->generation.load(std::memory_order_relaxed);
+    if ((generation & 1) == 0)
+    {
+        header->generation.store(generation + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
+
+size_t m6502::SharedMem::publish()
+{
+    begin_update(); // in case the host didn't
+    const uint64_t stamp = header->generation.load(std::memory_order_relaxed) + 1;
+
+    size_t changedPages = 0;
+    Mem::DirtyPages dirty = memory->dirty_pages_since(dirtyVersion);
+    for (size_t word = 0; word < dirty.size(); word++)
+    {
+        for (uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+        {
+            size_t page = word * 64 + std::countr_zero(bits);
+            header->pageStamps[page].store(stamp, std::memory_order_relaxed);
+            changedPages++;
+        }
+    }
+
+    header->generation.store(stamp, std::memory_order_release);
+    return changedPages;
+}
+
+m6502::SharedMemReader::SharedMemReader(int fd)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "fstat");
+    }
+    if ((size_t)info.st_size < SharedMemHeader::IMAGE_OFFSET + Mem::MEM_SIZE)
+    {
+        throw std::runtime_error("not a m6502 shared memory export: too small");
+    }
+
+    mappingSize = SharedMemHeader::IMAGE_OFFSET + Mem::MEM_SIZE;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    header = static_cast<const SharedMemHeader*>(mapping);
+    if (header->magic != SharedMemHeader::MAGIC || header->version != SharedMemHeader::VERSION)
+    {
+        munmap(mapping, mappingSize);
+        throw std::runtime_error("not a m6502 shared memory export: bad magic or version");
+    }
+    liveImage = static_cast<const uint8_t*>(mapping) + SharedMemHeader::IMAGE_OFFSET;
+}
+
+m6502::SharedMemReader::~SharedMemReader()
+{
+    munmap(mapping, mappingSize);
+}
+
+m6502::SharedMemReader::UpdateResult m6502::SharedMemReader::update(std::array<uint8_t, Mem::MEM_SIZE>& image, int maxAttempts)
+{
+    for (int attempt = 0; attempt < maxAttempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            std::this_thread::yield();
+        }
+        const uint64_t generation = header->generation.load(std::memory_order_acquire);
+        if (generation & 1)
+        {
+            continue; // the writer is mid update
+        }
+
+        size_t stagedCount = 0;
+        for (size_t page = 0; page < SharedMemHeader::PAGE_COUNT; page++)
+        {
+            if (!initialized || header->pageStamps[page].load(std::memory_order_relaxed) > lastGeneration)
+            {
+                size_t offset = page * SharedMemHeader::PAGE_SIZE;
+                std::memcpy(staging.data() + offset, liveImage + offset, SharedMemHeader::PAGE_SIZE);
+                stagedPages[stagedCount++] = (uint16_t)page;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->generation.load(std::memory_order_relaxed) != generation)
+        {
+            continue; // torn, the writer started another update while we copied
+        }
+        for (size_t i = 0; i < stagedCount; i++)
+        {
+            size_t offset = stagedPages[i] * SharedMemHeader::PAGE_SIZE;
+            std::memcpy(image.data() + offset, staging.data() + offset, SharedMemHeader::PAGE_SIZE);
+        }
+        lastGeneration = generation;
+        initialized = true;
+        return {false, stagedCount};
+    }
+    return {true, 0};
+}
+
+#else
+
+// memfd_create is Linux only
+
+m6502::SharedMem::SharedMem(const char*)
+{
+    throw std::system_error(std::make_error_code(std::errc::function_not_supported), "memfd_create");
+}
+
+m6502::SharedMem::~SharedMem() = default;
+
+void m6502::SharedMem::begin_update()
+{
+}
+
+size_t m6502::SharedMem::publish()
+{
+    return 0;
+}
+
+m6502::SharedMemReader::SharedMemReader(int)
+{
+    throw std::system_error(std::make_error_code(std::errc::function_not_supported), "memfd_create");
+}
+
+m6502::SharedMemReader::~SharedMemReader() = default;
+
+m6502::SharedMemReader::UpdateResult m6502::SharedMemReader::update(std::array<uint8_t, Mem::MEM_SIZE>&, int)
+{
+    return {true, 0};
+}
+
+#endif
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "6502.h"
+
+// Shared memory export of the emulated memory for external monitors (memory viewers, framebuffer scrapers, ...).
+//
+// SharedMem places a Mem inside a memfd_create mapping, so the CPU reads and writes the shared image directly and
+// nothing is copied. Other processes open /proc/<pid>/fd/<fd> and map it read-only, SharedMemReader does that for
+// C++ tools. A seqlock style generation counter plus per page stamps let readers copy only the pages that changed.
+//
+// publish() stamps the pages Mem marked dirty since the previous publish. It keeps its own position in Mem's dirty
+// marks, so a StateHash can watch the same Mem. Host writes through Mem::operator[] have to be marked with
+// Mem::mark_dirty() to be seen.
+// Between begin_update() and publish() the generation is odd. Readers retry a bounded number of times and then
+// report the writer as busy, keeping their stale but consistent copy; a host that never calls begin_update() gives
+// readers a live but possibly torn view.
+//
+// Linux only. Elsewhere the constructors throw std::system_error.
+
+namespace m6502
+{
+    struct SharedMemHeader
+    {
+        static constexpr uint32_t MAGIC = 0x36353032; // "6502"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr size_t PAGE_SIZE = Mem::PAGE_SIZE;
+        static constexpr size_t PAGE_COUNT = Mem::MEM_SIZE / PAGE_SIZE;
+        // the image starts on its own host page, so readers can also map it alone
+        static constexpr size_t IMAGE_OFFSET = 4096;
+
+        uint32_t magic;
+        uint32_t version;
+        // seqlock. odd while the image and the stamps are being updated
+        std::atomic<uint64_t> generation;
+        // generation in which each page last changed
+        std::atomic<uint64_t> pageStamps[PAGE_COUNT];
+    };
+    static_assert(sizeof(SharedMemHeader) <= SharedMemHeader::IMAGE_OFFSET, "header must fit in front of the image");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the seqlock must work across processes");
+
+    class SharedMem;
+    class SharedMemReader;
+}
+
+class m6502::SharedMem
+{
+public:
+    /** creates the memfd (name shows up in /proc/<pid>/fd) and places a zeroed Mem in it. throws std::system_error */
+    explicit SharedMem(const char* name = "m6502-mem");
+    ~SharedMem();
+
+    SharedMem(const SharedMem&) = delete;
+    SharedMem& operator=(const SharedMem&) = delete;
+
+    /** the shared image. hand this to the CPU */
+    Mem& mem() { return *memory; }
+    /** the memfd, for passing to other processes */
+    int fd() const { return memFd; }
+    uint64_t generation() const { return header->generation.load(std::memory_order_relaxed); }
+
+    /** call before the CPU writes to mem(). readers wait until the matching publish() */
+    void begin_update();
+    /** stamps the dirty pages and makes the image consistent for readers. @return the number of stamped pages */
+    size_t publish();
+
+private:
+    int memFd = -1;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    SharedMemHeader* header = nullptr;
+    Mem* memory = nullptr;
+    uint64_t dirtyVersion = 0; // see Mem::dirty_pages_since()
+};
+
+class m6502::SharedMemReader
+{
+public:
+    /** maps a SharedMem's fd read-only. throws std::system_error, or std::runtime_error if fd isn't a SharedMem */
+    explicit SharedMemReader(int fd);
+    ~SharedMemReader();
+
+    SharedMemReader(const SharedMemReader&) = delete;
+    SharedMemReader& operator=(const SharedMemReader&) = delete;
+
+    static constexpr int DEFAULT_ATTEMPTS = 64;
+
+    struct UpdateResult
+    {
+        // the writer was mid update on every attempt. image and generation() were left as they were
+        bool busy;
+        size_t copiedPages;
+    };
+
+    /** copies the pages that changed since the previous update (everything on the first one) into image. gives up
+     *  after maxAttempts tries, yielding in between, so a dead or busy writer can't hang the reader */
+    UpdateResult update(std::array<uint8_t, Mem::MEM_SIZE>& image, int maxAttempts = DEFAULT_ATTEMPTS);
+    /** the generation image was last brought up to */
+    uint64_t generation() const { return lastGeneration; }
+
+private:
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    const SharedMemHeader* header = nullptr;
+    const uint8_t* liveImage = nullptr;
+    // pages are copied here first and only reach the caller's image once the generation checks out
+    std::array<uint8_t, Mem::MEM_SIZE> staging;
+    std::array<uint16_t, SharedMemHeader::PAGE_COUNT> stagedPages;
+    uint64_t lastGeneration = 0;
+    bool initialized = false;
+};
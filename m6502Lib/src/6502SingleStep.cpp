@@ -0,0 +1,267 @@
+﻿#include "6502SingleStep.h"
+
+#include <stdexcept>
+
+m6502::SingleStepReader::SingleStepReader(std::istream& input)
+    : input(input), buffer(64 * 1024)
+{
+}
+
+int m6502::SingleStepReader::peek()
+{
+    if (position == length)
+    {
+        consumed += length;
+        input.read(buffer.data(), buffer.size());
+        length = static_cast<size_t>(input.gcount());
+        position = 0;
+        if (length == 0)
+        {
+            return EOF;
+        }
+    }
+    return static_cast<unsigned char>(buffer[position]);
+}
+
+int m6502::SingleStepReader::get()
+{
+    int c = peek();
+    if (c != EOF)
+    {
+        position++;
+    }
+    return c;
+}
+
+void m6502::SingleStepReader::skip_whitespace()
+{
+    for (int c = peek(); c == ' ' || c == '\n' || c == '\r' || c == '\t'; c = peek())
+    {
+        position++;
+    }
+}
+
+void m6502::SingleStepReader::expect(char expected)
+{
+    skip_whitespace();
+    if (get() != expected)
+    {
+        fail(std::string("expected '") + expected + "'");
+    }
+}
+
+bool m6502::SingleStepReader::more(char close)
+{
+    skip_whitespace();
+    int c = get();
+    if (c == ',')
+    {
+        return true;
+    }
+    if (c != close)
+    {
+        fail(close == ']' ? "expected ',' or ']'" : "expected ',' or '}'");
+    }
+    return false;
+}
+
+void m6502::SingleStepReader::parse_string(std::string& text)
+{
+    expect('"');
+    text.clear();
+    for (int c = get(); c != '"'; c = get())
+    {
+        if (c == EOF)
+        {
+            fail("unterminated string");
+        }
+        if (c == '\\')
+        {
+            // the corpora don't escape anything interesting, keep the escaped character as is
+            c = get();
+        }
+        text.push_back(static_cast<char>(c));
+    }
+}
+
+uint32_t m6502::SingleStepReader::parse_integer()
+{
+    skip_whitespace();
+    int c = peek();
+    if (c < '0' || c > '9')
+    {
+        fail("expected an unsigned integer");
+    }
+    uint32_t value = 0;
+    for (; c >= '0' && c <= '9'; c = peek())
+    {
+        value = value * 10 + (c - '0');
+        position++;
+    }
+    return value;
+}
+
+void m6502::SingleStepReader::parse_state(SingleStepState& state)
+{
+    state.ram.clear(); // a state without "ram" has none, whatever the previous case had
+    expect('{');
+    skip_whitespace();
+    if (peek() == '}')
+    {
+        position++;
+        return;
+    }
+    do
+    {
+        parse_string(key);
+        expect(':');
+        if (key == "pc")
+            state.PC = static_cast<uint16_t>(parse_integer());
+        else if (key == "s")
+            state.SP = static_cast<uint8_t>(parse_integer());
+        else if (key == "a")
+            state.A = static_cast<uint8_t>(parse_integer());
+        else if (key == "x")
+            state.X = static_cast<uint8_t>(parse_integer());
+        else if (key == "y")
+            state.Y = static_cast<uint8_t>(parse_integer());
+        else if (key == "p")
+            state.P = static_cast<uint8_t>(parse_integer());
+        else if (key == "ram")
+            parse_ram(state.ram);
+        else
+            skip_value();
+    } while (more('}'));
+}
+
+void m6502::SingleStepReader::parse_ram(std::vector<std::pair<uint16_t, uint8_t>>& ram)
+{
+    ram.clear();
+    expect('[');
+    skip_whitespace();
+    if (peek() == ']')
+    {
+        position++;
+        return;
+    }
+    do
+    {
+        expect('[');
+        uint16_t address = static_cast<uint16_t>(parse_integer());
+        expect(',');
+        uint8_t value = static_cast<uint8_t>(parse_integer());
+        expect(']');
+        ram.emplace_back(address, value);
+    } while (more(']'));
+}
+
+size_t m6502::SingleStepReader::parse_cycles()
+{
+    expect('[');
+    skip_whitespace();
+    if (peek() == ']')
+    {
+        position++;
+        return 0;
+    }
+    size_t cycles = 0;
+    do
+    {
+        skip_value();
+        cycles++;
+    } while (more(']'));
+    return cycles;
+}
+
+void m6502::SingleStepReader::skip_value()
+{
+    skip_whitespace();
+    int c = peek();
+    if (c == '"')
+    {
+        parse_string(key);
+    }
+    else if (c == '[' || c == '{')
+    {
+        position++;
+        const char close = c == '[' ? ']' : '}';
+        skip_whitespace();
+        if (peek() == close)
+        {
+            position++;
+            return;
+        }
+        do
+        {
+            if (close == '}')
+            {
+                parse_string(key);
+                expect(':');
+            }
+            skip_value();
+        } while (more(close));
+    }
+    else
+    {
+        // numbers, true, false and null
+        for (; c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); c = peek())
+        {
+            position++;
+        }
+    }
+}
+
+void m6502::SingleStepReader::fail(const std::string& message)
+{
+    throw std::runtime_error(message + " at byte " + std::to_string(consumed + position));
+}
+
+bool m6502::SingleStepReader::next(SingleStepCase& testCase)
+{
+    if (finished)
+    {
+        return false;
+    }
+    if (!started)
+    {
+        expect('[');
+        started = true;
+        skip_whitespace();
+        if (peek() == ']')
+        {
+            position++;
+            finished = true;
+            return false;
+        }
+    }
+    else if (!more(']'))
+    {
+        finished = true;
+        return false;
+    }
+
+    testCase.cycles = 0;
+    expect('{');
+    skip_whitespace();
+    if (peek() == '}')
+    {
+        position++;
+        return true;
+    }
+    do
+    {
+        parse_string(key);
+        expect(':');
+        if (key == "name")
+            parse_string(testCase.name);
+        else if (key == "initial")
+            parse_state(testCase.initial);
+        else if (key == "final")
+            parse_state(testCase.expected);
+        else if (key == "cycles")
+            testCase.cycles = parse_cycles();
+        else
+            skip_value();
+    } while (more('}'));
+    return true;
+}
@@ -0,0 +1,182 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "6502.h"
+
+// Single step conformance cases, in the JSON format of the per opcode ProcessorTests corpora:
+//
+//   [ { "name": "a9 5b 1c",
+//       "initial": { "pc": 1234, "s": 253, "a": 0, "x": 0, "y": 0, "p": 36, "ram": [ [1234, 169], [1235, 91] ] },
+//       "final":   { ... },
+//       "cycles":  [ [1234, 169, "read"], [1235, 91, "read"] ] }, ... ]
+//
+// SingleStepReader pulls one case at a time out of a stream, so a file of tens of thousands of cases is never held
+// in memory, and the case's vectors are reused from one case to the next. run_single_step() sets up only the bytes
+// a case lists, runs one instruction and clears those bytes again, so the same zeroed Mem serves every case. Writes
+// anywhere else are found through the pages Mem marks dirty, reported as failures and cleared as well.
+
+namespace m6502
+{
+    struct SingleStepState
+    {
+        uint16_t PC = 0;
+        uint8_t SP = 0;
+        uint8_t A = 0;
+        uint8_t X = 0;
+        uint8_t Y = 0;
+        uint8_t P = 0;
+        std::vector<std::pair<uint16_t, uint8_t>> ram;
+    };
+
+    struct SingleStepCase
+    {
+        std::string name;
+        SingleStepState initial;
+        SingleStepState expected; // "final" in the JSON
+        // only the number of bus cycles is checked, the emulator doesn't model the individual accesses
+        size_t cycles = 0;
+    };
+
+    class SingleStepReader;
+
+    /** runs testCase on cpu. memory must be all zeroes and is left that way, its dirty marks are used up.
+     *  @return a description of the mismatches, empty if it passed */
+    template <typename CPUType>
+    std::string run_single_step(const SingleStepCase& testCase, CPUType& cpu, Mem& memory);
+}
+
+class m6502::SingleStepReader
+{
+public:
+    explicit SingleStepReader(std::istream& input);
+
+    /** parses the next case into testCase. @return false after the last case. throws std::runtime_error on malformed input */
+    bool next(SingleStepCase& testCase);
+
+private:
+    // the stream is read in blocks, the parser works on the buffer
+    int peek();
+    int get();
+    void skip_whitespace();
+    void expect(char expected);
+    /** consumes a ',' and returns true, or consumes close and returns false */
+    bool more(char close);
+
+    void parse_string(std::string& text);
+    uint32_t parse_integer();
+    void parse_state(SingleStepState& state);
+    void parse_ram(std::vector<std::pair<uint16_t, uint8_t>>& ram);
+    size_t parse_cycles();
+    void skip_value();
+    [[noreturn]] void fail(const std::string& message);
+
+    std::istream& input;
+    std::vector<char> buffer;
+    size_t position = 0;
+    size_t length = 0;
+    size_t consumed = 0; // bytes before the buffer, for error messages
+    bool started = false;
+    bool finished = false;
+    std::string key;
+};
+
+template <typename CPUType>
+std::string m6502::run_single_step(const SingleStepCase& testCase, CPUType& cpu, Mem& memory)
+{
+    const SingleStepState& initial = testCase.initial;
+    const SingleStepState& expected = testCase.expected;
+
+    cpu.PC = initial.PC;
+    cpu.SP = initial.SP;
+    cpu.A = initial.A;
+    cpu.X = initial.X;
+    cpu.Y = initial.Y;
+    cpu.set_status(initial.P);
+    for (auto [address, value] : initial.ram)
+    {
+        memory[address] = value;
+    }
+
+    // unfused, a budget of one cycle runs exactly one instruction. the dirty pages are then the ones it wrote
+    cpu.fusionEnabled = false;
+    memory.take_dirty_pages();
+    size_t cycles = cpu.execute(1, memory);
+    const Mem::DirtyPages written = memory.take_dirty_pages();
+
+    // B only exists on the stack and bit 5 always reads as set
+    const uint8_t expectedStatus = (expected.P | FLAG_UNUSED) & ~FLAG_B;
+    bool passed = cpu.PC == expected.PC && cpu.SP == expected.SP && cpu.A == expected.A && cpu.X == expected.X
+        && cpu.Y == expected.Y && cpu.get_status(false) == expectedStatus && cycles == testCase.cycles;
+    for (auto [address, value] : expected.ram)
+    {
+        passed = passed && memory[address] == value;
+    }
+
+    // the description is only built for failures, passing cases stay cheap
+    std::string mismatches;
+    if (!passed)
+    {
+        std::ostringstream description;
+        description << std::hex;
+        auto check = [&](const char* what, unsigned actual, unsigned wanted) {
+            if (actual != wanted)
+            {
+                description << what << " $" << actual << " expected $" << wanted << "; ";
+            }
+        };
+        check("PC", cpu.PC, expected.PC);
+        check("SP", cpu.SP, expected.SP);
+        check("A", cpu.A, expected.A);
+        check("X", cpu.X, expected.X);
+        check("Y", cpu.Y, expected.Y);
+        check("P", cpu.get_status(false), expectedStatus);
+        for (auto [address, value] : expected.ram)
+        {
+            if (memory[address] != value)
+            {
+                description << "[$" << address << "] $" << (unsigned)memory[address] << " expected $" << (unsigned)value << "; ";
+            }
+        }
+        if (cycles != testCase.cycles)
+        {
+            description << std::dec << "cycles " << cycles << " expected " << testCase.cycles << "; ";
+        }
+        mismatches = description.str();
+    }
+
+    for (auto [address, value] : initial.ram)
+    {
+        memory[address] = 0;
+    }
+    for (auto [address, value] : expected.ram)
+    {
+        memory[address] = 0;
+    }
+
+    // with the listed bytes cleared, anything left on a written page is a write the case doesn't expect
+    for (size_t page = 0; page < Mem::PAGE_COUNT; page++)
+    {
+        if (((written[page / 64] >> (page % 64)) & 1) == 0)
+        {
+            continue;
+        }
+        for (size_t address = page * Mem::PAGE_SIZE; address < (page + 1) * Mem::PAGE_SIZE; address++)
+        {
+            if (memory[address] != 0)
+            {
+                std::ostringstream description;
+                description << std::hex << "stray write [$" << address << "] $" << (unsigned)memory[address] << "; ";
+                mismatches += description.str();
+                memory[address] = 0;
+            }
+        }
+    }
+    return mismatches;
+}
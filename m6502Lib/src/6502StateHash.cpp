@@ -0,0 +1,147 @@
+﻿#include "6502StateHash.h"
+
+#include <bit>
+
+namespace
+{
+    // xxHash64's primes and mixing steps. the page hash follows its stripe loop for a fixed 256 byte input
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ull;
+
+    // little endian whatever the host is, so hashes match across hosts
+    inline uint64_t load_le64(const uint8_t* bytes)
+    {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+
+    inline uint64_t hash_round(uint64_t accumulator, uint64_t input)
+    {
+        return std::rotl(accumulator + input * PRIME_2, 31) * PRIME_1;
+    }
+
+    inline uint64_t merge_round(uint64_t accumulator, uint64_t lane)
+    {
+        return (accumulator ^ hash_round(0, lane)) * PRIME_1 + PRIME_4;
+    }
+
+    inline uint64_t avalanche(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= PRIME_2;
+        hash ^= hash >> 29;
+        hash *= PRIME_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    // parent of two tree nodes. order matters, so swapped subtrees hash differently
+    inline uint64_t combine(uint64_t left, uint64_t right)
+    {
+        return avalanche(merge_round(merge_round(PRIME_5, left), right));
+    }
+}
+
+uint64_t m6502::hash_page(const uint8_t* page, uint64_t seed)
+{
+    // four independent lanes over 32 byte stripes keep the multipliers busy
+    uint64_t lanes[4] = { seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 };
+    for (size_t offset = 0; offset < Mem::PAGE_SIZE; offset += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            lanes[lane] = hash_round(lanes[lane], load_le64(page + offset + lane * 8));
+        }
+    }
+
+    uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+    for (uint64_t lane : lanes)
+    {
+        hash = merge_round(hash, lane);
+    }
+    return avalanche(hash + Mem::PAGE_SIZE);
+}
+
+void m6502::StateHash::update_memory(Mem& memory)
+{
+    Mem::DirtyPages dirty = memory.dirty_pages_since(dirtyVersion);
+    if (!initialized)
+    {
+        dirty = Mem::all_pages_dirty();
+        initialized = true;
+    }
+
+    rehashedPages = 0;
+    // internal nodes above a page whose hash changed
+    std::array<bool, PAGE_COUNT> stale{};
+    bool anyStale = false;
+    for (size_t word = 0; word < dirty.size(); word++)
+    {
+        for (uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+        {
+            size_t page = word * 64 + std::countr_zero(bits);
+            uint64_t hash = hash_page(memory.mem.data() + page * Mem::PAGE_SIZE, page);
+            rehashedPages++;
+
+            size_t node = PAGE_COUNT + page;
+            if (nodes[node] == hash)
+            {
+                continue; // written with the same contents
+            }
+            nodes[node] = hash;
+            for (node /= 2; node >= 1 && !stale[node]; node /= 2)
+            {
+                stale[node] = true;
+            }
+            anyStale = true;
+        }
+    }
+
+    if (anyStale)
+    {
+        // children come after their parents, so going backwards rebuilds bottom up
+        for (size_t node = PAGE_COUNT - 1; node >= 1; node--)
+        {
+            if (stale[node])
+            {
+                nodes[node] = combine(nodes[2 * node], nodes[2 * node + 1]);
+            }
+        }
+    }
+}
+
+uint64_t m6502::StateHash::update_registers(uint16_t PC, uint8_t SP, uint8_t A, uint8_t X, uint8_t Y, uint8_t status)
+{
+    uint64_t registers = PC | ((uint64_t)SP << 16) | ((uint64_t)A << 24) | ((uint64_t)X << 32) | ((uint64_t)Y << 40)
+        | ((uint64_t)status << 48);
+    registersHash = avalanche(registers * PRIME_1 + PRIME_5);
+    rootHash = combine(nodes[1], registersHash);
+    return rootHash;
+}
+
+int m6502::StateHash::first_difference(const StateHash& a, const StateHash& b)
+{
+    if (a.rootHash == b.rootHash)
+    {
+        return NO_DIFFERENCE;
+    }
+    if (a.nodes[1] == b.nodes[1])
+    {
+        return REGISTERS_DIFFER;
+    }
+
+    // follow the differing child down to a leaf, preferring the lower half
+    size_t node = 1;
+    while (node < PAGE_COUNT)
+    {
+        node = a.nodes[2 * node] != b.nodes[2 * node] ? 2 * node : 2 * node + 1;
+    }
+    return static_cast<int>(node - PAGE_COUNT);
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "6502.h"
+
+// Incremental hash of the whole machine state, for checking that two engines or hosts stay in lockstep.
+//
+// Every page of Mem is hashed on its own (a fast 64 bit non-cryptographic hash) and the page hashes are the leaves
+// of a binary Merkle tree. The root is combined with a hash of the register file. update() only rehashes the pages
+// Mem marked dirty since the previous update, so a slice that wrote a handful of pages costs a handful of page
+// hashes plus the tree nodes above them, and a slice that wrote nothing costs next to nothing.
+//
+// Two StateHashes can be compared with first_difference(), which walks down the trees to the first page that
+// differs in O(log pages).
+//
+// Each StateHash keeps its own position in Mem's dirty marks, so several of them, or a SharedMem, can watch the same
+// Mem. Host writes through Mem::operator[] have to be marked with Mem::mark_dirty() to be seen.
+
+namespace m6502
+{
+    /** hashes one page. seed keeps equal pages at different addresses apart */
+    uint64_t hash_page(const uint8_t* page, uint64_t seed);
+
+    class StateHash;
+}
+
+class m6502::StateHash
+{
+public:
+    static constexpr size_t PAGE_COUNT = Mem::PAGE_COUNT;
+    // first_difference() results that aren't a page
+    static constexpr int NO_DIFFERENCE = -1;
+    static constexpr int REGISTERS_DIFFER = static_cast<int>(PAGE_COUNT);
+
+    /** rehashes the pages marked dirty since the previous update and folds in the registers. the first update hashes every page. @return the root */
+    template <typename Variant>
+    uint64_t update(const BasicCPU<Variant>& cpu, Mem& memory)
+    {
+        update_memory(memory);
+        return update_registers(cpu.PC, cpu.SP, cpu.A, cpu.X, cpu.Y, cpu.get_status(false));
+    }
+
+    /** the hash of the memory and the registers as of the last update */
+    uint64_t root() const { return rootHash; }
+    /** the root of the page tree */
+    uint64_t memory_root() const { return nodes[1]; }
+    uint64_t page_hash(size_t page) const { return nodes[PAGE_COUNT + page]; }
+    /** the number of pages hashed by the last update */
+    size_t rehashed_pages() const { return rehashedPages; }
+
+    /** @return the lowest page whose hash differs, REGISTERS_DIFFER if only the registers do, or NO_DIFFERENCE */
+    static int first_difference(const StateHash& a, const StateHash& b);
+
+private:
+    void update_memory(Mem& memory);
+    uint64_t update_registers(uint16_t PC, uint8_t SP, uint8_t A, uint8_t X, uint8_t Y, uint8_t status);
+
+    // the tree in heap order: nodes[1] is the memory root, the children of node n are 2n and 2n + 1, and
+    // the page hashes are the leaves at PAGE_COUNT + page. nodes[0] is unused
+    std::array<uint64_t, 2 * PAGE_COUNT> nodes{};
+    uint64_t registersHash = 0;
+    uint64_t rootHash = 0;
+    size_t rehashedPages = 0;
+    uint64_t dirtyVersion = 0; // see Mem::dirty_pages_since()
+    bool initialized = false;
+};
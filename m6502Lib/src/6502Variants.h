@@ -0,0 +1,217 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// CPU variant traits. Each variant describes its opcode map and behavior as compile time constants,
+// so BasicCPU<Variant> gets a fully specialized handler for every opcode with no runtime variant checks.
+
+namespace m6502
+{
+    enum class Mnemonic : uint8_t
+    {
+        // documented NMOS instructions
+        ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+        CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+        JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+        RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+
+        // 65C02 additions (WDC)
+        BRA, PHX, PHY, PLX, PLY, STZ, TRB, TSB, RMB, SMB, BBR, BBS, WAI, STP,
+
+        // NMOS undocumented instructions
+        LAX, SAX, SLO, RLA, SRE, RRA, DCP, ISC, ANC, ALR, ARR, SBX, ANE, LXA,
+        LAS, SHA, SHX, SHY, TAS, JAM,
+    };
+
+    // the assembler spelling of a mnemonic, for reports and debugging
+    constexpr const char* mnemonic_name(Mnemonic mnemonic)
+    {
+        constexpr const char* names[] = {
+            "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC",
+            "CLD", "CLI", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP",
+            "JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI",
+            "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA",
+            "BRA", "PHX", "PHY", "PLX", "PLY", "STZ", "TRB", "TSB", "RMB", "SMB", "BBR", "BBS", "WAI", "STP",
+            "LAX", "SAX", "SLO", "RLA", "SRE", "RRA", "DCP", "ISC", "ANC", "ALR", "ARR", "SBX", "ANE", "LXA",
+            "LAS", "SHA", "SHX", "SHY", "TAS", "JAM",
+        };
+        static_assert(std::size(names) == static_cast<size_t>(Mnemonic::JAM) + 1, "one name per mnemonic");
+        return names[static_cast<size_t>(mnemonic)];
+    }
+
+    enum class AddrMode : uint8_t
+    {
+        None,               // no operand and no internal cycle (65C02 single cycle NOPs)
+        Implied,
+        Accumulator,
+        Immediate,
+        ZeroPage,
+        ZeroPageX,
+        ZeroPageY,
+        Absolute,
+        AbsoluteX,
+        AbsoluteY,
+        Indirect,           // JMP (abs)
+        IndirectX,          // (zp,X)
+        IndirectY,          // (zp),Y
+        ZeroPageIndirect,   // (zp), 65C02 only
+        AbsoluteIndirectX,  // JMP (abs,X), 65C02 only
+        Relative,
+        ZeroPageRelative,   // BBR/BBS zp,rel, 65C02 only
+    };
+
+    struct OpInfo
+    {
+        Mnemonic mnemonic;
+        AddrMode mode;
+        uint8_t extraCycles = 0; // internal cycles the addressing mode does not account for
+    };
+
+    using OpcodeTable = std::array<OpInfo, 256>;
+
+    namespace detail
+    {
+        constexpr AddrMode
+            NON = AddrMode::None,       IMP = AddrMode::Implied,    ACC = AddrMode::Accumulator,
+            IMM = AddrMode::Immediate,  ZP  = AddrMode::ZeroPage,   ZPX = AddrMode::ZeroPageX,
+            ZPY = AddrMode::ZeroPageY,  ABS = AddrMode::Absolute,   ABX = AddrMode::AbsoluteX,
+            ABY = AddrMode::AbsoluteY,  IND = AddrMode::Indirect,   IZX = AddrMode::IndirectX,
+            IZY = AddrMode::IndirectY,  IZP = AddrMode::ZeroPageIndirect,
+            IAX = AddrMode::AbsoluteIndirectX,  REL = AddrMode::Relative,
+            ZPR = AddrMode::ZeroPageRelative;
+
+        // the complete NMOS map, undocumented opcodes included (see http://www.oxyron.de/html/opcodes02.html)
+        constexpr OpcodeTable make_nmos_illegal_table()
+        {
+            using enum Mnemonic;
+            return {{
+                /* 0x00 */ {BRK, IMP}, {ORA, IZX}, {JAM, IMP}, {SLO, IZX}, {NOP, ZP }, {ORA, ZP }, {ASL, ZP }, {SLO, ZP },
+                /* 0x08 */ {PHP, IMP}, {ORA, IMM}, {ASL, ACC}, {ANC, IMM}, {NOP, ABS}, {ORA, ABS}, {ASL, ABS}, {SLO, ABS},
+                /* 0x10 */ {BPL, REL}, {ORA, IZY}, {JAM, IMP}, {SLO, IZY}, {NOP, ZPX}, {ORA, ZPX}, {ASL, ZPX}, {SLO, ZPX},
+                /* 0x18 */ {CLC, IMP}, {ORA, ABY}, {NOP, IMP}, {SLO, ABY}, {NOP, ABX}, {ORA, ABX}, {ASL, ABX}, {SLO, ABX},
+                /* 0x20 */ {JSR, ABS}, {AND, IZX}, {JAM, IMP}, {RLA, IZX}, {BIT, ZP }, {AND, ZP }, {ROL, ZP }, {RLA, ZP },
+                /* 0x28 */ {PLP, IMP}, {AND, IMM}, {ROL, ACC}, {ANC, IMM}, {BIT, ABS}, {AND, ABS}, {ROL, ABS}, {RLA, ABS},
+                /* 0x30 */ {BMI, REL}, {AND, IZY}, {JAM, IMP}, {RLA, IZY}, {NOP, ZPX}, {AND, ZPX}, {ROL, ZPX}, {RLA, ZPX},
+                /* 0x38 */ {SEC, IMP}, {AND, ABY}, {NOP, IMP}, {RLA, ABY}, {NOP, ABX}, {AND, ABX}, {ROL, ABX}, {RLA, ABX},
+                /* 0x40 */ {RTI, IMP}, {EOR, IZX}, {JAM, IMP}, {SRE, IZX}, {NOP, ZP }, {EOR, ZP }, {LSR, ZP }, {SRE, ZP },
+                /* 0x48 */ {PHA, IMP}, {EOR, IMM}, {LSR, ACC}, {ALR, IMM}, {JMP, ABS}, {EOR, ABS}, {LSR, ABS}, {SRE, ABS},
+                /* 0x50 */ {BVC, REL}, {EOR, IZY}, {JAM, IMP}, {SRE, IZY}, {NOP, ZPX}, {EOR, ZPX}, {LSR, ZPX}, {SRE, ZPX},
+                /* 0x58 */ {CLI, IMP}, {EOR, ABY}, {NOP, IMP}, {SRE, ABY}, {NOP, ABX}, {EOR, ABX}, {LSR, ABX}, {SRE, ABX},
+                /* 0x60 */ {RTS, IMP}, {ADC, IZX}, {JAM, IMP}, {RRA, IZX}, {NOP, ZP }, {ADC, ZP }, {ROR, ZP }, {RRA, ZP },
+                /* 0x68 */ {PLA, IMP}, {ADC, IMM}, {ROR, ACC}, {ARR, IMM}, {JMP, IND}, {ADC, ABS}, {ROR, ABS}, {RRA, ABS},
+                /* 0x70 */ {BVS, REL}, {ADC, IZY}, {JAM, IMP}, {RRA, IZY}, {NOP, ZPX}, {ADC, ZPX}, {ROR, ZPX}, {RRA, ZPX},
+                /* 0x78 */ {SEI, IMP}, {ADC, ABY}, {NOP, IMP}, {RRA, ABY}, {NOP, ABX}, {ADC, ABX}, {ROR, ABX}, {RRA, ABX},
+                /* 0x80 */ {NOP, IMM}, {STA, IZX}, {NOP, IMM}, {SAX, IZX}, {STY, ZP }, {STA, ZP }, {STX, ZP }, {SAX, ZP },
+                /* 0x88 */ {DEY, IMP}, {NOP, IMM}, {TXA, IMP}, {ANE, IMM}, {STY, ABS}, {STA, ABS}, {STX, ABS}, {SAX, ABS},
+                /* 0x90 */ {BCC, REL}, {STA, IZY}, {JAM, IMP}, {SHA, IZY}, {STY, ZPX}, {STA, ZPX}, {STX, ZPY}, {SAX, ZPY},
+                /* 0x98 */ {TYA, IMP}, {STA, ABY}, {TXS, IMP}, {TAS, ABY}, {SHY, ABX}, {STA, ABX}, {SHX, ABY}, {SHA, ABY},
+                /* 0xA0 */ {LDY, IMM}, {LDA, IZX}, {LDX, IMM}, {LAX, IZX}, {LDY, ZP }, {LDA, ZP }, {LDX, ZP }, {LAX, ZP },
+                /* 0xA8 */ {TAY, IMP}, {LDA, IMM}, {TAX, IMP}, {LXA, IMM}, {LDY, ABS}, {LDA, ABS}, {LDX, ABS}, {LAX, ABS},
+                /* 0xB0 */ {BCS, REL}, {LDA, IZY}, {JAM, IMP}, {LAX, IZY}, {LDY, ZPX}, {LDA, ZPX}, {LDX, ZPY}, {LAX, ZPY},
+                /* 0xB8 */ {CLV, IMP}, {LDA, ABY}, {TSX, IMP}, {LAS, ABY}, {LDY, ABX}, {LDA, ABX}, {LDX, ABY}, {LAX, ABY},
+                /* 0xC0 */ {CPY, IMM}, {CMP, IZX}, {NOP, IMM}, {DCP, IZX}, {CPY, ZP }, {CMP, ZP }, {DEC, ZP }, {DCP, ZP },
+                /* 0xC8 */ {INY, IMP}, {CMP, IMM}, {DEX, IMP}, {SBX, IMM}, {CPY, ABS}, {CMP, ABS}, {DEC, ABS}, {DCP, ABS},
+                /* 0xD0 */ {BNE, REL}, {CMP, IZY}, {JAM, IMP}, {DCP, IZY}, {NOP, ZPX}, {CMP, ZPX}, {DEC, ZPX}, {DCP, ZPX},
+                /* 0xD8 */ {CLD, IMP}, {CMP, ABY}, {NOP, IMP}, {DCP, ABY}, {NOP, ABX}, {CMP, ABX}, {DEC, ABX}, {DCP, ABX},
+                /* 0xE0 */ {CPX, IMM}, {SBC, IZX}, {NOP, IMM}, {ISC, IZX}, {CPX, ZP }, {SBC, ZP }, {INC, ZP }, {ISC, ZP },
+                /* 0xE8 */ {INX, IMP}, {SBC, IMM}, {NOP, IMP}, {SBC, IMM}, {CPX, ABS}, {SBC, ABS}, {INC, ABS}, {ISC, ABS},
+                /* 0xF0 */ {BEQ, REL}, {SBC, IZY}, {JAM, IMP}, {ISC, IZY}, {NOP, ZPX}, {SBC, ZPX}, {INC, ZPX}, {ISC, ZPX},
+                /* 0xF8 */ {SED, IMP}, {SBC, ABY}, {NOP, IMP}, {ISC, ABY}, {NOP, ABX}, {SBC, ABX}, {INC, ABX}, {ISC, ABX},
+            }};
+        }
+
+        constexpr bool is_undocumented(uint8_t opcode, Mnemonic mnemonic)
+        {
+            // 0xEA is the only official NOP and 0xEB is an undocumented copy of SBC #imm
+            if (mnemonic == Mnemonic::NOP)
+            {
+                return opcode != 0xEA;
+            }
+            return opcode == 0xEB || mnemonic >= Mnemonic::LAX;
+        }
+
+        // the documented NMOS map. undocumented opcodes behave like the single byte NOP
+        constexpr OpcodeTable make_nmos_table()
+        {
+            OpcodeTable table = make_nmos_illegal_table();
+            for (size_t opcode = 0; opcode < table.size(); opcode++)
+            {
+                if (is_undocumented(static_cast<uint8_t>(opcode), table[opcode].mnemonic))
+                {
+                    table[opcode] = {Mnemonic::NOP, IMP};
+                }
+            }
+            return table;
+        }
+
+        // WDC 65C02. the unused opcodes are NOPs of fixed length and timing
+        constexpr OpcodeTable make_65c02_table()
+        {
+            using enum Mnemonic;
+            return {{
+                /* 0x00 */ {BRK, IMP}, {ORA, IZX}, {NOP, IMM}, {NOP, NON}, {TSB, ZP }, {ORA, ZP }, {ASL, ZP }, {RMB, ZP },
+                /* 0x08 */ {PHP, IMP}, {ORA, IMM}, {ASL, ACC}, {NOP, NON}, {TSB, ABS}, {ORA, ABS}, {ASL, ABS}, {BBR, ZPR},
+                /* 0x10 */ {BPL, REL}, {ORA, IZY}, {ORA, IZP}, {NOP, NON}, {TRB, ZP }, {ORA, ZPX}, {ASL, ZPX}, {RMB, ZP },
+                /* 0x18 */ {CLC, IMP}, {ORA, ABY}, {INC, ACC}, {NOP, NON}, {TRB, ABS}, {ORA, ABX}, {ASL, ABX}, {BBR, ZPR},
+                /* 0x20 */ {JSR, ABS}, {AND, IZX}, {NOP, IMM}, {NOP, NON}, {BIT, ZP }, {AND, ZP }, {ROL, ZP }, {RMB, ZP },
+                /* 0x28 */ {PLP, IMP}, {AND, IMM}, {ROL, ACC}, {NOP, NON}, {BIT, ABS}, {AND, ABS}, {ROL, ABS}, {BBR, ZPR},
+                /* 0x30 */ {BMI, REL}, {AND, IZY}, {AND, IZP}, {NOP, NON}, {BIT, ZPX}, {AND, ZPX}, {ROL, ZPX}, {RMB, ZP },
+                /* 0x38 */ {SEC, IMP}, {AND, ABY}, {DEC, ACC}, {NOP, NON}, {BIT, ABX}, {AND, ABX}, {ROL, ABX}, {BBR, ZPR},
+                /* 0x40 */ {RTI, IMP}, {EOR, IZX}, {NOP, IMM}, {NOP, NON}, {NOP, ZP }, {EOR, ZP }, {LSR, ZP }, {RMB, ZP },
+                /* 0x48 */ {PHA, IMP}, {EOR, IMM}, {LSR, ACC}, {NOP, NON}, {JMP, ABS}, {EOR, ABS}, {LSR, ABS}, {BBR, ZPR},
+                /* 0x50 */ {BVC, REL}, {EOR, IZY}, {EOR, IZP}, {NOP, NON}, {NOP, ZPX}, {EOR, ZPX}, {LSR, ZPX}, {RMB, ZP },
+                /* 0x58 */ {CLI, IMP}, {EOR, ABY}, {PHY, IMP}, {NOP, NON}, {NOP, ABS, 4}, {EOR, ABX}, {LSR, ABX}, {BBR, ZPR},
+                /* 0x60 */ {RTS, IMP}, {ADC, IZX}, {NOP, IMM}, {NOP, NON}, {STZ, ZP }, {ADC, ZP }, {ROR, ZP }, {RMB, ZP },
+                /* 0x68 */ {PLA, IMP}, {ADC, IMM}, {ROR, ACC}, {NOP, NON}, {JMP, IND, 1}, {ADC, ABS}, {ROR, ABS}, {BBR, ZPR},
+                /* 0x70 */ {BVS, REL}, {ADC, IZY}, {ADC, IZP}, {NOP, NON}, {STZ, ZPX}, {ADC, ZPX}, {ROR, ZPX}, {RMB, ZP },
+                /* 0x78 */ {SEI, IMP}, {ADC, ABY}, {PLY, IMP}, {NOP, NON}, {JMP, IAX}, {ADC, ABX}, {ROR, ABX}, {BBR, ZPR},
+                /* 0x80 */ {BRA, REL}, {STA, IZX}, {NOP, IMM}, {NOP, NON}, {STY, ZP }, {STA, ZP }, {STX, ZP }, {SMB, ZP },
+                /* 0x88 */ {DEY, IMP}, {BIT, IMM}, {TXA, IMP}, {NOP, NON}, {STY, ABS}, {STA, ABS}, {STX, ABS}, {BBS, ZPR},
+                /* 0x90 */ {BCC, REL}, {STA, IZY}, {STA, IZP}, {NOP, NON}, {STY, ZPX}, {STA, ZPX}, {STX, ZPY}, {SMB, ZP },
+                /* 0x98 */ {TYA, IMP}, {STA, ABY}, {TXS, IMP}, {NOP, NON}, {STZ, ABS}, {STA, ABX}, {STZ, ABX}, {BBS, ZPR},
+                /* 0xA0 */ {LDY, IMM}, {LDA, IZX}, {LDX, IMM}, {NOP, NON}, {LDY, ZP }, {LDA, ZP }, {LDX, ZP }, {SMB, ZP },
+                /* 0xA8 */ {TAY, IMP}, {LDA, IMM}, {TAX, IMP}, {NOP, NON}, {LDY, ABS}, {LDA, ABS}, {LDX, ABS}, {BBS, ZPR},
+                /* 0xB0 */ {BCS, REL}, {LDA, IZY}, {LDA, IZP}, {NOP, NON}, {LDY, ZPX}, {LDA, ZPX}, {LDX, ZPY}, {SMB, ZP },
+                /* 0xB8 */ {CLV, IMP}, {LDA, ABY}, {TSX, IMP}, {NOP, NON}, {LDY, ABX}, {LDA, ABX}, {LDX, ABY}, {BBS, ZPR},
+                /* 0xC0 */ {CPY, IMM}, {CMP, IZX}, {NOP, IMM}, {NOP, NON}, {CPY, ZP }, {CMP, ZP }, {DEC, ZP }, {SMB, ZP },
+                /* 0xC8 */ {INY, IMP}, {CMP, IMM}, {DEX, IMP}, {WAI, IMP, 1}, {CPY, ABS}, {CMP, ABS}, {DEC, ABS}, {BBS, ZPR},
+                /* 0xD0 */ {BNE, REL}, {CMP, IZY}, {CMP, IZP}, {NOP, NON}, {NOP, ZPX}, {CMP, ZPX}, {DEC, ZPX}, {SMB, ZP },
+                /* 0xD8 */ {CLD, IMP}, {CMP, ABY}, {PHX, IMP}, {STP, IMP, 1}, {NOP, ABS}, {CMP, ABX}, {DEC, ABX}, {BBS, ZPR},
+                /* 0xE0 */ {CPX, IMM}, {SBC, IZX}, {NOP, IMM}, {NOP, NON}, {CPX, ZP }, {SBC, ZP }, {INC, ZP }, {SMB, ZP },
+                /* 0xE8 */ {INX, IMP}, {SBC, IMM}, {NOP, IMP}, {NOP, NON}, {CPX, ABS}, {SBC, ABS}, {INC, ABS}, {BBS, ZPR},
+                /* 0xF0 */ {BEQ, REL}, {SBC, IZY}, {SBC, IZP}, {NOP, NON}, {NOP, ZPX}, {SBC, ZPX}, {INC, ZPX}, {SMB, ZP },
+                /* 0xF8 */ {SED, IMP}, {SBC, ABY}, {PLX, IMP}, {NOP, NON}, {NOP, ABS}, {SBC, ABX}, {INC, ABX}, {BBS, ZPR},
+            }};
+        }
+    }
+
+    // original NMOS 6502, documented instructions only
+    struct NMOS
+    {
+        static constexpr const char* name = "6502";
+        static constexpr bool decimalMode = true;   // ADC/SBC honour the D flag
+        static constexpr bool cmos = false;         // CMOS timing, flag and bug fixes
+        static constexpr OpcodeTable opcodes = detail::make_nmos_table();
+    };
+
+    // NMOS 6502 including the undocumented opcodes (LAX, SAX, DCP, ...)
+    struct NMOSIllegal
+    {
+        static constexpr const char* name = "6502 (undocumented)";
+        static constexpr bool decimalMode = true;
+        static constexpr bool cmos = false;
+        static constexpr OpcodeTable opcodes = detail::make_nmos_illegal_table();
+    };
+
+    // WDC 65C02. valid N/Z in decimal mode (for an extra cycle), no JMP (ind) page bug, BRK clears D
+    struct CMOS65C02
+    {
+        static constexpr const char* name = "65C02";
+        static constexpr bool decimalMode = true;
+        static constexpr bool cmos = true;
+        static constexpr OpcodeTable opcodes = detail::make_65c02_table();
+    };
+}
@@ -0,0 +1,293 @@
+﻿#include "RunJob.h"
+#include "6502.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+namespace
+{
+    using namespace m6502;
+
+    bool parse_address(const std::string& text, int32_t& address)
+    {
+        int64_t value;
+        if (!parse_number(text, 0xFFFF, value))
+        {
+            return false;
+        }
+        address = static_cast<int32_t>(value);
+        return true;
+    }
+
+    std::string load_image(const ImageSpec& image, Mem& memory)
+    {
+        std::ifstream file(image.path, std::ios::binary);
+        if (!file)
+        {
+            return "cannot open " + image.path;
+        }
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (image.address + bytes.size() > Mem::MEM_SIZE)
+        {
+            char address[8];
+            snprintf(address, sizeof(address), "$%04X", image.address);
+            return image.path + " does not fit at " + address;
+        }
+        memory.load_block(image.address, bytes.data(), bytes.size());
+        return "";
+    }
+
+    void set_vector(Mem& memory, uint16_t address, int32_t value)
+    {
+        if (value >= 0)
+        {
+            memory[address] = value & 0xFF;
+            memory[address + 1] = value >> 8;
+        }
+    }
+
+    // ends the slice on the first write to the exit address, whatever the value
+    class ExitPort : public OutputSink
+    {
+    public:
+        explicit ExitPort(uint16_t address) : address(address) {}
+
+        bool write(uint16_t written, uint8_t value, uint64_t) override
+        {
+            if (written != address)
+            {
+                return false; // the rest of the page
+            }
+            exited = true;
+            exitCode = value;
+            return true;
+        }
+
+        const uint16_t address;
+        bool exited = false;
+        uint8_t exitCode = 0;
+    };
+
+    template <typename CPUType>
+    RunResult run_on(const RunJob& job, Mem& memory)
+    {
+        RunResult result;
+        CPUType cpu;
+        cpu.reset(memory);
+
+        for (const ImageSpec& image : job.images)
+        {
+            result.error = load_image(image, memory);
+            if (!result.error.empty())
+            {
+                return result;
+            }
+        }
+        set_vector(memory, 0xFFFA, job.nmiVector);
+        set_vector(memory, 0xFFFC, job.resetVector);
+        set_vector(memory, 0xFFFE, job.irqVector);
+        // start like the hardware does, from the reset vector
+        cpu.PC = memory[0xFFFC] | (memory[0xFFFD] << 8);
+
+        std::unique_ptr<ExitPort> exitPort;
+        if (job.exitAddress >= 0)
+        {
+            exitPort = std::make_unique<ExitPort>(static_cast<uint16_t>(job.exitAddress));
+            cpu.outputSink = exitPort.get();
+            cpu.outputPages[job.exitAddress >> 8] = true;
+        }
+
+        std::vector<bool> isTrap(Mem::MEM_SIZE);
+        for (uint16_t trap : job.traps)
+        {
+            isTrap[trap] = true;
+        }
+
+        // traps and BRKs have to be caught before the instruction there executes, so jobs with either check every
+        // instruction and run unfused. everything else runs on the production execute()
+        const bool checkEveryInstruction = job.haltOnBrk || !job.traps.empty();
+        bool halted = false;
+        auto stop = [&](const CPUType& cpu, const Mem& memory) {
+            if (isTrap[cpu.PC])
+            {
+                result.reason = StopReason::Trap;
+            }
+            else if (job.haltOnBrk && memory[cpu.PC] == 0x00)
+            {
+                result.reason = StopReason::Brk;
+            }
+            else
+            {
+                return false;
+            }
+            halted = true;
+            return true;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        while (result.cycles < job.maxCycles)
+        {
+            // execute() counts in 32 bits, so long jobs run in slices
+            int32_t slice = static_cast<int32_t>(std::min<int64_t>(job.maxCycles - result.cycles, 1 << 24));
+            result.cycles += checkEveryInstruction ? cpu.execute_until(slice, memory, stop) : cpu.execute(slice, memory);
+            if (exitPort && exitPort->exited)
+            {
+                result.reason = StopReason::Exit;
+                result.exitCode = exitPort->exitCode;
+                halted = true;
+            }
+            if (halted)
+            {
+                break;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!halted)
+        {
+            result.reason = StopReason::CycleLimit;
+        }
+        result.PC = cpu.PC;
+        result.instructions = static_cast<int64_t>(cpu.instructionCount);
+        return result;
+    }
+}
+
+bool m6502::parse_number(const std::string& text, int64_t maxValue, int64_t& value)
+{
+    try
+    {
+        size_t used = 0;
+        if (!text.empty() && text[0] == '$')
+        {
+            value = std::stoll(text.substr(1), &used, 16);
+            used++;
+        }
+        else
+        {
+            value = std::stoll(text, &used, 0);
+        }
+        return used == text.size() && value >= 0 && value <= maxValue;
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
+
+const char* m6502::stop_reason_name(StopReason reason)
+{
+    switch (reason)
+    {
+    case StopReason::Trap:
+        return "trap";
+    case StopReason::Brk:
+        return "brk";
+    case StopReason::Exit:
+        return "exit";
+    case StopReason::CycleLimit:
+        return "cycle limit";
+    case StopReason::Error:
+        break;
+    }
+    return "error";
+}
+
+std::string m6502::parse_job_args(const std::vector<std::string>& args, RunJob& job)
+{
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::string& arg = args[i];
+        if (arg.empty() || arg[0] != '-')
+        {
+            // image, optionally with a load address: file.bin@0x0600
+            size_t at = arg.rfind('@');
+            int32_t address = 0;
+            if (at != std::string::npos && !parse_address(arg.substr(at + 1), address))
+            {
+                return "bad load address in " + arg;
+            }
+            job.images.push_back({arg.substr(0, at), static_cast<uint16_t>(address)});
+            if (job.name.empty())
+            {
+                job.name = arg;
+            }
+            continue;
+        }
+
+        if (arg == "--halt-on-brk")
+        {
+            job.haltOnBrk = true;
+            continue;
+        }
+        if (arg != "--name" && arg != "--cpu" && arg != "--reset" && arg != "--irq" && arg != "--nmi" && arg != "--trap"
+            && arg != "--exit" && arg != "--max-cycles")
+        {
+            return "unknown option " + arg;
+        }
+        if (i + 1 == args.size())
+        {
+            return arg + " needs a value";
+        }
+        const std::string& value = args[++i];
+
+        int32_t address;
+        int64_t number;
+        if (arg == "--name")
+        {
+            job.name = value;
+        }
+        else if (arg == "--cpu")
+        {
+            if (value != "6502" && value != "6502-undoc" && value != "65c02")
+            {
+                return "unknown cpu " + value;
+            }
+            job.cpu = value;
+        }
+        else if (arg == "--reset" || arg == "--irq" || arg == "--nmi" || arg == "--trap" || arg == "--exit")
+        {
+            if (!parse_address(value, address))
+            {
+                return "bad address for " + arg + ": " + value;
+            }
+            if (arg == "--reset")
+                job.resetVector = address;
+            else if (arg == "--irq")
+                job.irqVector = address;
+            else if (arg == "--nmi")
+                job.nmiVector = address;
+            else if (arg == "--trap")
+                job.traps.push_back(static_cast<uint16_t>(address));
+            else
+                job.exitAddress = address;
+        }
+        else if (arg == "--max-cycles")
+        {
+            if (!parse_number(value, INT64_MAX, number))
+            {
+                return "bad cycle count " + value;
+            }
+            job.maxCycles = number;
+        }
+    }
+    return "";
+}
+
+m6502::RunResult m6502::run_job(const RunJob& job)
+{
+    auto memory = std::make_unique<Mem>();
+    if (job.cpu == "65c02")
+    {
+        return run_on<CPU65C02>(job, *memory);
+    }
+    if (job.cpu == "6502-undoc")
+    {
+        return run_on<CPUIllegal>(job, *memory);
+    }
+    return run_on<CPU>(job, *memory);
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one m6502Run job: which images to load, how to start and when to stop
+
+namespace m6502
+{
+    struct ImageSpec
+    {
+        std::string path;
+        uint16_t address;
+    };
+
+    struct RunJob
+    {
+        std::string name;
+        std::string cpu = "6502";       // 6502, 6502-undoc or 65c02
+        std::vector<ImageSpec> images;
+        // vectors written after the images are loaded. -1 keeps whatever the images put there
+        int32_t resetVector = -1;
+        int32_t irqVector = -1;
+        int32_t nmiVector = -1;
+        // halt conditions. the cycle limit always applies
+        std::vector<uint16_t> traps;    // stop when PC reaches one of these. checked every instruction, unfused
+        bool haltOnBrk = false;         // stop when a BRK is about to execute. checked every instruction, unfused
+        int32_t exitAddress = -1;       // stop after the instruction that writes to this address
+        int64_t maxCycles = 1'000'000'000;
+    };
+
+    enum class StopReason
+    {
+        Trap,
+        Brk,
+        Exit,
+        CycleLimit,
+        Error,
+    };
+
+    struct RunResult
+    {
+        StopReason reason = StopReason::Error;
+        uint8_t exitCode = 0;           // the value written to the exit address
+        uint16_t PC = 0;
+        int64_t cycles = 0;
+        int64_t instructions = 0;
+        double seconds = 0.0;
+        std::string error;
+    };
+
+    const char* stop_reason_name(StopReason reason);
+
+    /** parses 1234, 0x04D2 or $04D2. @return false unless all of text is a number in [0, maxValue] */
+    bool parse_number(const std::string& text, int64_t maxValue, int64_t& value);
+
+    /** applies job options (see the usage text in main_6502Run.cpp) on top of job. @return an error message, empty on success */
+    std::string parse_job_args(const std::vector<std::string>& args, RunJob& job);
+
+    /** loads and runs a job to completion on the calling thread */
+    RunResult run_job(const RunJob& job);
+}
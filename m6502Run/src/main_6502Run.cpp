@@ -0,0 +1,225 @@
+﻿#include "RunJob.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+using namespace m6502;
+
+static const char* USAGE = R"(usage: m6502Run [options] [image[@addr] ...]
+
+Loads the images, sets the vectors and runs until a halt condition.
+Images are raw binaries, loaded at address 0 unless @addr is given.
+Execution starts at the reset vector ($FFFC).
+
+job options (on the command line, or per manifest line):
+  --name NAME          name to report the job under
+  --cpu CPU            6502 (default), 6502-undoc or 65c02
+  --reset ADDR         set the reset vector
+  --irq ADDR           set the IRQ/BRK vector
+  --nmi ADDR           set the NMI vector
+  --trap ADDR          stop when PC reaches ADDR (repeatable)
+  --halt-on-brk        stop when a BRK is about to execute
+                       (jobs with traps or --halt-on-brk check every instruction and run unfused, so they are slower)
+  --exit ADDR          stop after the instruction that writes to ADDR, the value is the job's exit code
+  --max-cycles N       cycle limit (default 1000000000)
+
+runner options:
+  --manifest FILE      one job per line, # starts a comment. command line job options are the defaults
+  -j, --jobs N         worker threads (default: all cores)
+  -q, --quiet          only print the summary
+
+ADDR and N take decimal, 0x or $ hex.
+exit status: 0 if every job halted on a trap, a BRK or exit code 0, 1 if a job failed to load, hit the cycle limit
+or exited with a nonzero code, 2 on usage errors
+)";
+
+static size_t peak_rss_kb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // KB on Linux
+#endif
+}
+
+static int usage_error(const std::string& message)
+{
+    fprintf(stderr, "m6502Run: %s\n\n%s", message.c_str(), USAGE);
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> jobDefaults;
+    std::string manifestPath;
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    bool quiet = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printf("%s", USAGE);
+            return 0;
+        }
+        else if (arg == "-q" || arg == "--quiet")
+        {
+            quiet = true;
+        }
+        else if (arg == "--manifest" || arg == "-j" || arg == "--jobs")
+        {
+            if (i + 1 == argc)
+            {
+                return usage_error(arg + " needs a value");
+            }
+            std::string value = argv[++i];
+            if (arg == "--manifest")
+            {
+                manifestPath = value;
+            }
+            else
+            {
+                int64_t count;
+                if (!parse_number(value, INT32_MAX, count) || count < 1)
+                {
+                    return usage_error("bad thread count " + value);
+                }
+                threadCount = static_cast<size_t>(count);
+            }
+        }
+        else
+        {
+            jobDefaults.push_back(arg);
+        }
+    }
+
+    std::vector<RunJob> jobs;
+    if (manifestPath.empty())
+    {
+        RunJob job;
+        std::string error = parse_job_args(jobDefaults, job);
+        if (!error.empty())
+        {
+            return usage_error(error);
+        }
+        jobs.push_back(job);
+    }
+    else
+    {
+        std::ifstream manifest(manifestPath);
+        if (!manifest)
+        {
+            return usage_error("cannot open manifest " + manifestPath);
+        }
+        std::string line;
+        for (int lineNumber = 1; std::getline(manifest, line); lineNumber++)
+        {
+            std::vector<std::string> args = jobDefaults;
+            std::istringstream words(line.substr(0, line.find('#')));
+            std::string word;
+            bool empty = true;
+            while (words >> word)
+            {
+                args.push_back(word);
+                empty = false;
+            }
+            if (empty)
+            {
+                continue;
+            }
+
+            RunJob job;
+            std::string error = parse_job_args(args, job);
+            if (!error.empty())
+            {
+                return usage_error(manifestPath + ":" + std::to_string(lineNumber) + ": " + error);
+            }
+            if (job.name.empty())
+            {
+                job.name = manifestPath + ":" + std::to_string(lineNumber);
+            }
+            jobs.push_back(job);
+        }
+    }
+    if (jobs.empty())
+    {
+        return usage_error("no jobs");
+    }
+
+    // workers pull the next job until there are none left
+    std::vector<RunResult> results(jobs.size());
+    std::atomic<size_t> nextJob = 0;
+    threadCount = std::min(threadCount, jobs.size());
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        workers.emplace_back([&]() {
+            for (size_t job = nextJob++; job < jobs.size(); job = nextJob++)
+            {
+                results[job] = run_job(jobs[job]);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int status = 0;
+    int64_t totalCycles = 0, totalInstructions = 0;
+    for (size_t job = 0; job < jobs.size(); job++)
+    {
+        const RunResult& result = results[job];
+        totalCycles += result.cycles;
+        totalInstructions += result.instructions;
+        if (result.reason == StopReason::Error || result.reason == StopReason::CycleLimit
+            || (result.reason == StopReason::Exit && result.exitCode != 0))
+        {
+            status = 1;
+        }
+        if (quiet && result.reason != StopReason::Error)
+        {
+            continue;
+        }
+
+        if (result.reason == StopReason::Error)
+        {
+            printf("%s: error: %s\n", jobs[job].name.c_str(), result.error.c_str());
+            continue;
+        }
+        printf("%s: %s", jobs[job].name.c_str(), stop_reason_name(result.reason));
+        if (result.reason == StopReason::Exit)
+        {
+            printf(" %d", result.exitCode);
+        }
+        printf(" at $%04X, %lld cycles, %lld instructions, %.1f MHz\n", result.PC, (long long)result.cycles,
+               (long long)result.instructions, result.seconds > 0 ? result.cycles / result.seconds / 1e6 : 0.0);
+    }
+
+    printf("jobs:                 %zu on %zu threads\n", jobs.size(), threadCount);
+    printf("cycles:               %lld\n", (long long)totalCycles);
+    printf("instructions retired: %lld\n", (long long)totalInstructions);
+    printf("wall time:            %.3f s\n", seconds);
+    printf("emulated MHz:         %.1f\n", seconds > 0 ? totalCycles / seconds / 1e6 : 0.0);
+    printf("peak RSS:             %zu KB\n", peak_rss_kb());
+    return status;
+}
@@ -0,0 +1,269 @@
+﻿#include "6502ALU.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace m6502;
+
+static constexpr uint8_t NVZC = FLAG_N | FLAG_V | FLAG_Z | FLAG_C;
+static constexpr uint8_t NZC = FLAG_N | FLAG_Z | FLAG_C;
+
+// runs check(a, operand, carry) over every input combination
+template <typename Check>
+static void ForAllInputs(Check check)
+{
+    for (uint32_t carry = 0; carry < 2; carry++)
+    {
+        for (uint32_t a = 0; a < 256; a++)
+        {
+            for (uint32_t operand = 0; operand < 256; operand++)
+            {
+                check((uint8_t)a, (uint8_t)operand, (uint8_t)carry);
+            }
+        }
+    }
+}
+
+// EXPECT_EQ on every input would flood the output, so count the mismatches and report the first one
+#define EXPECT_ALU_EQ(fast, slow, mask)                                                                        \
+    if ((fast).value != (slow).value || ((fast).flags & (mask)) != ((slow).flags & (mask)))                    \
+    {                                                                                                          \
+        if (mismatches++ == 0)                                                                                 \
+        {                                                                                                      \
+            ADD_FAILURE() << "a=" << (int)a << " operand=" << (int)operand << " carry=" << (int)carry          \
+                          << " got " << (int)(fast).value << "/" << (int)(fast).flags << " expected "          \
+                          << (int)(slow).value << "/" << (int)(slow).flags;                                    \
+        }                                                                                                      \
+    }
+
+TEST(m6502ALUTest, BinaryADCMatchesTheReferenceForAllInputs)
+{
+    int mismatches = 0;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        EXPECT_ALU_EQ(alu::adc_binary(a, operand, carry), alu::reference::adc(a, operand, carry, false, false), NVZC);
+    });
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(m6502ALUTest, BinarySBCMatchesTheReferenceForAllInputs)
+{
+    int mismatches = 0;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        EXPECT_ALU_EQ(alu::sbc_binary(a, operand, carry), alu::reference::sbc(a, operand, carry, false, false), NVZC);
+    });
+    EXPECT_EQ(mismatches, 0);
+}
+
+// the decimal tables are generated from alu::reference, so they are checked against a second model instead: the nibble
+// at a time adjustment used by VICE, written from the NMOS behavior rather than from the 6502.org sequences
+static AluResult NibbleModelADC(uint8_t a, uint8_t operand, uint8_t carry, bool cmos)
+{
+    uint32_t low = (a & 0x0F) + (operand & 0x0F) + carry;
+    if (low > 9)
+    {
+        low += 6;
+    }
+    uint32_t high = (a >> 4) + (operand >> 4) + (low > 0x0F);
+    uint8_t flags = 0;
+    if (((a + operand + carry) & 0xFF) == 0)
+    {
+        flags |= FLAG_Z;
+    }
+    if (high & 0x08)
+    {
+        flags |= FLAG_N;
+    }
+    if (~(a ^ operand) & (a ^ (high << 4)) & 0x80)
+    {
+        flags |= FLAG_V;
+    }
+    if (high > 9)
+    {
+        high += 6;
+    }
+    if (high > 0x0F)
+    {
+        flags |= FLAG_C;
+    }
+    uint8_t value = (uint8_t)(high << 4 | (low & 0x0F));
+    if (cmos)
+    {
+        // same result, carry and overflow. N and Z come from the result
+        flags = (flags & (FLAG_V | FLAG_C)) | alu::ZN_FLAGS[value];
+    }
+    return {value, flags};
+}
+
+// the NMOS SBC. all flags are those of the binary subtraction
+static AluResult NibbleModelSBC(uint8_t a, uint8_t operand, uint8_t carry)
+{
+    uint32_t borrow = 1 - carry;
+    uint32_t binary = a - operand - borrow;
+    uint32_t low = (a & 0x0F) - (operand & 0x0F) - borrow;
+    uint32_t value;
+    if (low & 0x10)
+    {
+        value = ((low - 6) & 0x0F) | ((a & 0xF0) - (operand & 0xF0) - 0x10);
+    }
+    else
+    {
+        value = (low & 0x0F) | ((a & 0xF0) - (operand & 0xF0));
+    }
+    if (value & 0x100)
+    {
+        value -= 0x60;
+    }
+    uint8_t flags = alu::ZN_FLAGS[binary & 0xFF];
+    if (binary < 0x100)
+    {
+        flags |= FLAG_C;
+    }
+    if ((a ^ binary) & (a ^ operand) & 0x80)
+    {
+        flags |= FLAG_V;
+    }
+    return {(uint8_t)value, flags};
+}
+
+static bool IsValidBCD(uint8_t value)
+{
+    return (value & 0x0F) <= 9 && (value >> 4) <= 9;
+}
+
+TEST(m6502ALUTest, DecimalADCMatchesTheNibbleModelForAllInputs)
+{
+    int mismatches = 0;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        EXPECT_ALU_EQ(alu::adc_decimal<false>(a, operand, carry), NibbleModelADC(a, operand, carry, false), NVZC);
+        EXPECT_ALU_EQ(alu::adc_decimal<true>(a, operand, carry), NibbleModelADC(a, operand, carry, true), NVZC);
+    });
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(m6502ALUTest, DecimalSBCMatchesTheNibbleModelForAllInputs)
+{
+    int mismatches = 0;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        AluResult nmos = NibbleModelSBC(a, operand, carry);
+        EXPECT_ALU_EQ(alu::sbc_decimal<false>(a, operand, carry), nmos, NVZC);
+
+        // the 65C02 keeps C and V, takes N and Z from the result, and only agrees with the NMOS result for valid BCD
+        AluResult cmos = alu::sbc_decimal<true>(a, operand, carry);
+        AluResult expected = {IsValidBCD(a) && IsValidBCD(operand) ? nmos.value : cmos.value,
+                              (uint8_t)((nmos.flags & (FLAG_V | FLAG_C)) | alu::ZN_FLAGS[cmos.value])};
+        EXPECT_ALU_EQ(cmos, expected, NVZC);
+    });
+    EXPECT_EQ(mismatches, 0);
+}
+
+// FNV-1a over every (carry, A, operand) entry of a decimal operation, result and NVZC flags
+template <typename Operation>
+static uint64_t DecimalChecksum(Operation operation)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        AluResult result = operation(a, operand, carry);
+        for (uint8_t byte : {result.value, (uint8_t)(result.flags & NVZC)})
+        {
+            hash = (hash ^ byte) * 0x100000001B3ull;
+        }
+    });
+    return hash;
+}
+
+// pins down the whole of all four tables, including the 65C02 SBC results for invalid BCD the nibble model leaves open
+TEST(m6502ALUTest, DecimalTablesMatchTheGoldenChecksums)
+{
+    EXPECT_EQ(DecimalChecksum(alu::adc_decimal<false>), 0xB6BCB43071FDCAC1ull);
+    EXPECT_EQ(DecimalChecksum(alu::sbc_decimal<false>), 0xF7F5755F662B9E25ull);
+    EXPECT_EQ(DecimalChecksum(alu::adc_decimal<true>), 0x9D07DFA47BF945B3ull);
+    EXPECT_EQ(DecimalChecksum(alu::sbc_decimal<true>), 0x5348CE3DFE5FFD9Dull);
+}
+
+TEST(m6502ALUTest, CompareAndShiftsMatchTheReferenceForAllInputs)
+{
+    int mismatches = 0;
+    ForAllInputs([&](uint8_t a, uint8_t operand, uint8_t carry) {
+        // the compare result itself isn't kept, only its flags
+        AluResult fast = alu::compare(a, operand), slow = alu::reference::compare(a, operand);
+        EXPECT_ALU_EQ(fast, slow, NZC);
+        if (operand == 0) // the shifts only have one operand
+        {
+            EXPECT_ALU_EQ(alu::asl(a), alu::reference::shift(a, carry, true, false), NZC);
+            EXPECT_ALU_EQ(alu::lsr(a), alu::reference::shift(a, carry, false, false), NZC);
+            EXPECT_ALU_EQ(alu::rol(a, carry), alu::reference::shift(a, carry, true, true), NZC);
+            EXPECT_ALU_EQ(alu::ror(a, carry), alu::reference::shift(a, carry, false, true), NZC);
+        }
+    });
+    EXPECT_EQ(mismatches, 0);
+}
+
+// known values from http://www.6502.org/tutorials/decimal_mode.html, so the reference itself is pinned down
+TEST(m6502ALUTest, DecimalModeMatchesKnownHardwareResults)
+{
+    AluResult sum = alu::adc_decimal<false>(0x58, 0x46, 1); // 58 + 46 + 1 = 105
+    EXPECT_EQ(sum.value, 0x05);
+    EXPECT_TRUE(sum.flags & FLAG_C);
+
+    AluResult difference = alu::sbc_decimal<false>(0x46, 0x12, 1); // 46 - 12 = 34
+    EXPECT_EQ(difference.value, 0x34);
+    EXPECT_TRUE(difference.flags & FLAG_C);
+
+    difference = alu::sbc_decimal<false>(0x21, 0x34, 1); // 21 - 34 = -13 -> 87 with a borrow
+    EXPECT_EQ(difference.value, 0x87);
+    EXPECT_FALSE(difference.flags & FLAG_C);
+
+    // 99 + 1: the NMOS Z comes from the binary sum (0x9A), the 65C02 one from the result
+    EXPECT_FALSE(alu::adc_decimal<false>(0x99, 0x01, 0).flags & FLAG_Z);
+    EXPECT_TRUE(alu::adc_decimal<true>(0x99, 0x01, 0).flags & FLAG_Z);
+
+    // invalid BCD: the NMOS and 65C02 disagree on the result
+    EXPECT_NE(alu::sbc_decimal<false>(0x00, 0x0F, 1).value, alu::sbc_decimal<true>(0x00, 0x0F, 1).value);
+}
+
+// run with --gtest_also_run_disabled_tests. the inputs are shuffled so the reference's branches can't be learned
+TEST(m6502ALUTest, DISABLED_BenchmarkAgainstTheReference)
+{
+    constexpr int ROUNDS = 20;
+    std::vector<uint32_t> inputs(2 * 256 * 256);
+    std::iota(inputs.begin(), inputs.end(), 0);
+    std::shuffle(inputs.begin(), inputs.end(), std::mt19937(6502));
+
+    using Clock = std::chrono::steady_clock;
+    auto run = [&](auto operation) {
+        uint32_t checksum = 0;
+        auto start = Clock::now();
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            for (uint32_t input : inputs)
+            {
+                AluResult result = operation(input >> 8 & 0xFF, input & 0xFF, input >> 16);
+                checksum += result.value + result.flags;
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        return std::make_pair(ns / (ROUNDS * inputs.size()), checksum);
+    };
+
+    auto report = [&](const char* name, auto fast, auto slow) {
+        auto [fastNs, fastSum] = run(fast);
+        auto [slowNs, slowSum] = run(slow);
+        EXPECT_EQ(fastSum, slowSum);
+        printf("%-12s table/branchless %.2f ns/op, reference %.2f ns/op\n", name, fastNs, slowNs);
+    };
+
+    report("ADC binary", [](uint8_t a, uint8_t b, uint8_t c) { return alu::adc_binary(a, b, c); },
+           [](uint8_t a, uint8_t b, uint8_t c) { return alu::reference::adc(a, b, c, false, false); });
+    report("SBC binary", [](uint8_t a, uint8_t b, uint8_t c) { return alu::sbc_binary(a, b, c); },
+           [](uint8_t a, uint8_t b, uint8_t c) { return alu::reference::sbc(a, b, c, false, false); });
+    report("ADC decimal", [](uint8_t a, uint8_t b, uint8_t c) { return alu::adc_decimal<false>(a, b, c); },
+           [](uint8_t a, uint8_t b, uint8_t c) { return alu::reference::adc(a, b, c, true, false); });
+    report("SBC decimal", [](uint8_t a, uint8_t b, uint8_t c) { return alu::sbc_decimal<false>(a, b, c); },
+           [](uint8_t a, uint8_t b, uint8_t c) { return alu::reference::sbc(a, b, c, true, false); });
+    report("CMP", [](uint8_t a, uint8_t b, uint8_t) { return alu::compare(a, b); },
+           [](uint8_t a, uint8_t b, uint8_t) { return alu::reference::compare(a, b); });
+}
@@ -0,0 +1,185 @@
+﻿#include "6502Explore.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+using namespace m6502;
+
+class m6502ExploreTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPU cpu;
+    ExploreConfig config;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+        cpu.PC = 0x8000;
+        config.inputPages[0xD0] = true;
+        config.threads = 4;
+    }
+
+    void LoadProgram(const std::vector<uint8_t>& program)
+    {
+        mem.load_block(0x8000, program.data(), program.size());
+    }
+};
+
+TEST_F(m6502ExploreTest, FindsTheInputsThatReachATrap)
+{
+    // given:
+    LoadProgram({
+        0xAD, 0x00, 0xD0,       // 8000: LDA $D000
+        0xC9, 0x42,             // 8003: CMP #$42
+        0xD0, 0x0C,             // 8005: BNE $8013
+        0xAD, 0x01, 0xD0,       // 8007: LDA $D001
+        0x85, 0x10,             // 800A: STA $10
+        0xC9, 0x17,             // 800C: CMP #$17
+        0xD0, 0x03,             // 800E: BNE $8013
+        0x4C, 0x00, 0x90,       // 8010: JMP $9000
+        0x00,                   // 8013: BRK
+    });
+    config.traps = { 0x9000 };
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then:
+    EXPECT_TRUE(stats.complete);
+    ASSERT_EQ(stats.findings.size(), 1u);
+    EXPECT_EQ(stats.findings[0].PC, 0x9000);
+    ASSERT_EQ(stats.findings[0].inputs.size(), 2u);
+    EXPECT_EQ(stats.findings[0].inputs[0], (std::pair<uint16_t, uint8_t>(0xD000, 0x42)));
+    EXPECT_EQ(stats.findings[0].inputs[1], (std::pair<uint16_t, uint8_t>(0xD001, 0x17)));
+    EXPECT_EQ(stats.states, 1u + 256 + 256);
+    EXPECT_EQ(stats.halted, 255u + 255 + 1);
+    EXPECT_EQ(stats.coveredInstructions, 8u); // the BRK and the trap stop before they run
+}
+
+TEST_F(m6502ExploreTest, VisitedStatesAreNotExploredAgain)
+{
+    // given:
+    LoadProgram({
+        0xAD, 0x00, 0xD0,       // 8000: LDA $D000
+        0x4C, 0x00, 0x80,       // 8003: JMP $8000
+    });
+    config.inputChoices = [](uint16_t) { return std::vector<uint8_t>{ 1, 2 }; };
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then:
+    EXPECT_TRUE(stats.complete);
+    EXPECT_EQ(stats.states, 3u);     // the start, then A = 1 and A = 2 after the read
+    EXPECT_EQ(stats.duplicates, 4u); // each of those two reading 1 or 2 again
+    EXPECT_EQ(stats.timedOut, 0u);
+}
+
+TEST_F(m6502ExploreTest, SnapshotsShareUnchangedPages)
+{
+    // given: every input value is stored to its own page, which is all that differs between the states
+    LoadProgram({
+        0xAD, 0x00, 0xD0,       // 8000: LDA $D000
+        0xAA,                   // 8003: TAX
+        0x9D, 0x00, 0x20,       // 8004: STA $2000,X
+        0x00,                   // 8007: BRK
+    });
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then:
+    EXPECT_EQ(stats.states, 257u);
+    EXPECT_EQ(stats.halted, 256u);
+    EXPECT_LE(stats.pages, Mem::PAGE_COUNT + 256); // the initial pages, then one new $20 page per value
+}
+
+TEST_F(m6502ExploreTest, StopsAtTheStateLimit)
+{
+    // given: a counter that never repeats
+    LoadProgram({
+        0xAD, 0x00, 0xD0,       // 8000: LDA $D000
+        0xE6, 0x10,             // 8003: INC $10
+        0xD0, 0xF9,             // 8005: BNE $8000
+        0xE6, 0x11,             // 8007: INC $11
+        0x4C, 0x00, 0x80,       // 8009: JMP $8000
+    });
+    config.inputChoices = [](uint16_t) { return std::vector<uint8_t>{ 0, 1 }; };
+    config.maxStates = 1000;
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then:
+    EXPECT_FALSE(stats.complete);
+    EXPECT_GE(stats.states, 1000u);
+    EXPECT_LT(stats.states, 1100u);
+}
+
+TEST_F(m6502ExploreTest, BranchesStartAtTheReadingInstruction)
+{
+    // given: about 330000 cycles of delay loop before the only read
+    LoadProgram({
+        0xA2, 0x00,             // 8000: LDX #$00
+        0xA0, 0x00,             // 8002: LDY #$00
+        0x88,                   // 8004: DEY
+        0xD0, 0xFD,             // 8005: BNE $8004
+        0xCA,                   // 8007: DEX
+        0xD0, 0xFA,             // 8008: BNE $8004
+        0x6D, 0x00, 0xD0,       // 800A: ADC $D000
+        0x00,                   // 800D: BRK
+    });
+    CPU straightCpu = cpu;
+    Mem straightMem = mem;
+    const int32_t delayCycles = straightCpu.execute_until(1'000'000, straightMem,
+        [](const CPU& cpu, const Mem&) { return cpu.PC == 0x800A; });
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then: the delay runs once, not once per value, and the rolled back ADC isn't counted
+    EXPECT_TRUE(stats.complete);
+    EXPECT_EQ(stats.runs, 257u);
+    EXPECT_EQ(stats.states, 257u);
+    EXPECT_EQ(stats.halted, 256u);
+    EXPECT_EQ(stats.maxFrontier, 1u); // one fork, not 256 branches
+    EXPECT_EQ(stats.cycles, delayCycles + 256 * 4u);
+}
+
+// a device on the caller's CPU
+class CountingSink : public OutputSink
+{
+public:
+    std::atomic<size_t> writes = 0;
+    bool write(uint16_t, uint8_t, uint64_t) override
+    {
+        writes++;
+        return false;
+    }
+};
+
+TEST_F(m6502ExploreTest, WorkersDoNotCallTheCallersDevices)
+{
+    // given:
+    LoadProgram({
+        0xAD, 0x00, 0xD0,       // 8000: LDA $D000
+        0x8D, 0x00, 0x20,       // 8003: STA $2000
+        0x00,                   // 8006: BRK
+    });
+    CountingSink sink;
+    cpu.outputSink = &sink;
+    cpu.outputPages[0x20] = true;
+
+    // when:
+    Explorer<CPU> explorer(config);
+    ExploreStats stats = explorer.run(cpu, mem);
+
+    // then:
+    EXPECT_EQ(stats.halted, 256u);
+    EXPECT_EQ(sink.writes, 0u);
+}
@@ -0,0 +1,161 @@
+﻿#include "6502.h"
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace m6502;
+
+class m6502FusionTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPU cpu;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+    }
+
+    // copies 16 bytes with an LDA/STA abs,X + DEX/BNE loop, then counts Y up to 32 with INY/CPY/BNE, then spins
+    void LoadCopyLoopProgram(Mem& memory)
+    {
+        const uint8_t program[] = {
+            0xA2, 0x10,             // 8000: LDX #$10
+            0xBD, 0x00, 0x40,       // 8002: LDA $4000,X
+            0x9D, 0x00, 0x50,       // 8005: STA $5000,X
+            0xCA,                   // 8008: DEX
+            0xD0, 0xF7,             // 8009: BNE $8002
+            0xA0, 0x00,             // 800B: LDY #$00
+            0xC8,                   // 800D: INY
+            0xC0, 0x20,             // 800E: CPY #$20
+            0xD0, 0xFB,             // 8010: BNE $800D
+            0x4C, 0x12, 0x80,       // 8012: JMP $8012
+        };
+        for (size_t i = 0; i < sizeof(program); i++)
+        {
+            memory[0x8000 + i] = program[i];
+        }
+        for (uint16_t i = 0; i <= 0x10; i++)
+        {
+            memory[0x4000 + i] = 0xA0 + i;
+        }
+        memory[0xFFFC] = 0x4C; // JMP $8000
+        memory[0xFFFD] = 0x00;
+        memory[0xFFFE] = 0x80;
+    }
+};
+
+static void VerifySameMachineState(const CPU& cpu, const Mem& mem, const CPU& otherCpu, const Mem& otherMem)
+{
+    EXPECT_EQ(cpu.PC, otherCpu.PC);
+    EXPECT_EQ(cpu.SP, otherCpu.SP);
+    EXPECT_EQ(cpu.A, otherCpu.A);
+    EXPECT_EQ(cpu.X, otherCpu.X);
+    EXPECT_EQ(cpu.Y, otherCpu.Y);
+    EXPECT_EQ(cpu.get_status(false), otherCpu.get_status(false));
+    EXPECT_TRUE(mem.mem == otherMem.mem);
+}
+
+TEST_F(m6502FusionTest, FusedAndUnfusedExecutionAgreeForEveryCycleBudget)
+{
+    for (int32_t budget = 1; budget <= 8; budget++)
+    {
+        // given:
+        Mem unfusedMem;
+        CPU unfusedCpu;
+        unfusedCpu.reset(unfusedMem);
+        unfusedCpu.fusionEnabled = false;
+        cpu.reset(mem);
+        LoadCopyLoopProgram(mem);
+        LoadCopyLoopProgram(unfusedMem);
+
+        for (int slice = 0; slice < 200; slice++)
+        {
+            // when:
+            int32_t cyclesUsed = cpu.execute(budget, mem);
+            int32_t unfusedCyclesUsed = unfusedCpu.execute(budget, unfusedMem);
+
+            // then:
+            ASSERT_EQ(cyclesUsed, unfusedCyclesUsed) << "budget " << budget << " slice " << slice;
+            ASSERT_EQ(cpu.PC, unfusedCpu.PC) << "budget " << budget << " slice " << slice;
+        }
+        VerifySameMachineState(cpu, mem, unfusedCpu, unfusedMem);
+        EXPECT_EQ(mem[0x5001], 0xA1);
+        EXPECT_EQ(mem[0x5010], 0xB0);
+        EXPECT_EQ(cpu.Y, 0x20);
+    }
+}
+
+TEST_F(m6502FusionTest, FusionStopsWhenTheCycleBudgetIsUsedUp)
+{
+    // given:
+    mem[0xFFFC] = 0xCA; // DEX
+    mem[0xFFFD] = 0xD0; // BNE -2
+    mem[0xFFFE] = 0xFE;
+    cpu.X = 2;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(2, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 2);
+    EXPECT_EQ(cpu.PC, 0xFFFD);
+    EXPECT_EQ(cpu.X, 1);
+}
+
+TEST_F(m6502FusionTest, StatsCountFusedSequencesAndDispatchedPairs)
+{
+    // given:
+    auto stats = std::make_unique<FusionStats>();
+    cpu.fusionStats = stats.get();
+    LoadCopyLoopProgram(mem);
+
+    // when:
+    cpu.execute(2000, mem);
+
+    // then:
+    EXPECT_EQ(stats->fired[fusion_pattern_for(0xBD)], 16); // LDA abs,X; STA abs,X
+    EXPECT_EQ(stats->fired[fusion_pattern_for(0xCA)], 16); // DEX; BNE
+    EXPECT_EQ(stats->fired[fusion_pattern_for(0xC8)], 32); // INY; CPY #; BNE
+    EXPECT_EQ(stats->fired[fusion_pattern_for(0xA5)], 0);
+    EXPECT_GT(stats->dispatchedPairs[0x4C4C], 0u);        // JMP; JMP is never fused
+    EXPECT_EQ(stats->dispatchedPairs[0xBD9D], 0u);        // always fused
+
+    std::ostringstream report;
+    stats->report(report, NMOS::opcodes);
+    EXPECT_NE(report.str().find("DEX; BNE: 16"), std::string::npos);
+    EXPECT_NE(report.str().find("JMP ($4c); JMP ($4c)"), std::string::npos);
+}
+
+TEST_F(m6502FusionTest, DispatchedPairsStartFromTheLastFusedStep)
+{
+    // given:
+    auto stats = std::make_unique<FusionStats>();
+    cpu.fusionStats = stats.get();
+    const uint8_t program[] = {
+        0xA2, 0x03,             // 8000: LDX #$03
+        0xCA,                   // 8002: DEX
+        0xD0, 0xFD,             // 8003: BNE $8002
+        0xEA,                   // 8005: NOP
+        0x4C, 0x06, 0x80,       // 8006: JMP $8006
+    };
+    mem.load_block(0x8000, program, sizeof(program));
+    cpu.PC = 0x8000;
+
+    // when: LDX, DEX; BNE taken twice then not taken, NOP and one JMP
+    cpu.execute(2 + 5 + 5 + 4 + 2 + 3, mem);
+
+    // then:
+    EXPECT_EQ(stats->fired[fusion_pattern_for(0xCA)], 3);
+    EXPECT_EQ(stats->dispatchedPairs[0xA2CA], 1u); // LDX; DEX
+    EXPECT_EQ(stats->dispatchedPairs[0xD0CA], 2u); // BNE; DEX, the branch back
+    EXPECT_EQ(stats->dispatchedPairs[0xD0EA], 1u); // BNE; NOP, falling through
+    EXPECT_EQ(stats->dispatchedPairs[0xEA4C], 1u); // NOP; JMP
+    EXPECT_EQ(stats->dispatchedPairs[0xCACA], 0u);
+    EXPECT_EQ(stats->dispatchedPairs[0xCAEA], 0u);
+    uint64_t pairs = 0;
+    for (uint64_t count : stats->dispatchedPairs)
+    {
+        pairs += count;
+    }
+    EXPECT_EQ(pairs, 5u);
+}
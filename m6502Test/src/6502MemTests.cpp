@@ -0,0 +1,182 @@
+﻿#include "6502.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+using namespace m6502;
+
+class m6502MemTest : public testing::Test
+{
+public:
+    Mem mem;
+    virtual void SetUp() override
+    {
+        mem.initialize();
+        mem.take_dirty_pages();
+    }
+
+    size_t DirtyPageCount() const
+    {
+        size_t count = 0;
+        for (size_t page = 0; page < Mem::PAGE_COUNT; page++)
+        {
+            count += mem.is_dirty(page);
+        }
+        return count;
+    }
+};
+
+TEST_F(m6502MemTest, LoadBlockWrapsAndMarksOnlyTheTouchedPages)
+{
+    // given:
+    std::vector<uint8_t> data(0x300);
+    std::iota(data.begin(), data.end(), 0);
+
+    // when:
+    mem.load_block(0xFF80, data.data(), data.size());
+
+    // then:
+    EXPECT_EQ(mem[0xFF80], 0x00);
+    EXPECT_EQ(mem[0xFFFF], 0x7F);
+    EXPECT_EQ(mem[0x0000], 0x80);
+    EXPECT_EQ(mem[0x027F], 0xFF);
+    EXPECT_EQ(mem[0x0280], 0x00);
+    EXPECT_EQ(DirtyPageCount(), 4u); // $FF, $00, $01, $02
+    EXPECT_TRUE(mem.is_dirty(0xFF));
+    EXPECT_TRUE(mem.is_dirty(0x02));
+    EXPECT_FALSE(mem.is_dirty(0x03));
+
+    std::vector<uint8_t> readBack(data.size());
+    mem.read_block(0xFF80, readBack.data(), readBack.size());
+    EXPECT_EQ(readBack, data);
+}
+
+TEST_F(m6502MemTest, EveryConsumerSeesEachDirtyPageOnce)
+{
+    // given:
+    uint64_t first = 0, second = 0;
+    mem.dirty_pages_since(first);
+    mem.dirty_pages_since(second);
+    mem.fill(0x1200, 0x42, 1);
+
+    // when:
+    Mem::DirtyPages firstPages = mem.dirty_pages_since(first);
+    mem.fill(0x3400, 0x42, 1);
+    Mem::DirtyPages secondPages = mem.dirty_pages_since(second);
+
+    // then:
+    EXPECT_EQ(firstPages[0], 1ull << 0x12);
+    EXPECT_EQ(secondPages[0], (1ull << 0x12) | (1ull << 0x34));
+    EXPECT_EQ(DirtyPageCount(), 0u);
+    EXPECT_EQ(mem.dirty_pages_since(first)[0], 1ull << 0x34);
+    EXPECT_EQ(mem.dirty_pages_since(second)[0], 0u);
+}
+
+TEST_F(m6502MemTest, BlockTransfersStopAfterAllOfMemory)
+{
+    // given:
+    std::vector<uint8_t> data(Mem::MEM_SIZE + 16, 0xAA);
+    std::iota(data.begin(), data.begin() + Mem::MEM_SIZE, 0);
+
+    // when:
+    mem.load_block(0x8000, data.data(), data.size());
+    std::vector<uint8_t> readBack(data.size(), 0xEE);
+    mem.read_block(0x8000, readBack.data(), readBack.size());
+
+    // then:
+    EXPECT_EQ(mem[0x8000], 0x00); // not overwritten again by the last 16 bytes
+    EXPECT_EQ(mem[0x7FFF], 0xFF);
+    EXPECT_TRUE(std::equal(readBack.begin(), readBack.begin() + Mem::MEM_SIZE, data.begin()));
+    EXPECT_EQ(readBack[Mem::MEM_SIZE], 0xEE);
+    EXPECT_EQ(DirtyPageCount(), Mem::PAGE_COUNT);
+}
+
+TEST_F(m6502MemTest, FillWrapsAroundTheEndOfMemory)
+{
+    // when:
+    mem.fill(0xFFFE, 0xAA, 4);
+
+    // then:
+    EXPECT_EQ(mem[0xFFFD], 0x00);
+    EXPECT_EQ(mem[0xFFFE], 0xAA);
+    EXPECT_EQ(mem[0x0001], 0xAA);
+    EXPECT_EQ(mem[0x0002], 0x00);
+    EXPECT_EQ(DirtyPageCount(), 2u);
+}
+
+TEST_F(m6502MemTest, CopyBlockHandlesOverlapLikeMemmove)
+{
+    for (uint16_t source : { 0x1000, 0xFFF0 })
+    {
+        for (int shift : { -3, 3 })
+        {
+            // given:
+            mem.initialize();
+            for (int i = 0; i < 32; i++)
+            {
+                mem[(source + i) & 0xFFFF] = 0x40 + i;
+            }
+            uint16_t destination = (source + shift) & 0xFFFF;
+
+            // when:
+            mem.copy_block(destination, source, 32);
+
+            // then:
+            for (int i = 0; i < 32; i++)
+            {
+                ASSERT_EQ(mem[(destination + i) & 0xFFFF], 0x40 + i) << "source " << source << " shift " << shift << " byte " << i;
+            }
+        }
+    }
+}
+
+TEST_F(m6502MemTest, CopyBlockBetweenSeparateWrappingRanges)
+{
+    // given:
+    for (int i = 0; i < 16; i++)
+    {
+        mem[0x1000 + i] = 0x80 + i;
+    }
+
+    // when:
+    mem.copy_block(0xFFF8, 0x1000, 16);
+    mem.copy_block(0x2000, 0xFFF8, 16);
+
+    // then:
+    EXPECT_EQ(mem[0xFFF8], 0x80);
+    EXPECT_EQ(mem[0x0007], 0x8F);
+    EXPECT_EQ(mem[0x2000], 0x80);
+    EXPECT_EQ(mem[0x200F], 0x8F);
+}
+
+TEST_F(m6502MemTest, CompareReportsTheOrderOfTheFirstDifference)
+{
+    // given:
+    const uint8_t data[] = { 1, 2, 3, 4 };
+    mem.load_block(0xFFFE, data, sizeof(data));
+    const uint8_t bigger[] = { 1, 2, 3, 5 };
+
+    // then:
+    EXPECT_EQ(mem.compare(0xFFFE, data, sizeof(data)), 0);
+    EXPECT_LT(mem.compare(0xFFFE, bigger, sizeof(bigger)), 0);
+    EXPECT_GT(mem.compare(0x0000, data, 1), 0); // 3 > 1
+}
+
+TEST_F(m6502MemTest, FindPatternSearchesTheRangeAndAcrossTheWrap)
+{
+    // given:
+    const uint8_t pattern[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+    mem[0x0100] = 0xDE; // a partial match first
+    mem[0x0101] = 0xAD;
+    mem.load_block(0x4000, pattern, sizeof(pattern));
+    mem.load_block(0xFFFE, pattern, sizeof(pattern));
+
+    // then:
+    EXPECT_EQ(mem.find_pattern(pattern, sizeof(pattern)), 0x4000);
+    EXPECT_EQ(mem.find_pattern(pattern, sizeof(pattern), 0x4001), 0xFFFE);
+    EXPECT_EQ(mem.find_pattern(pattern, sizeof(pattern), 0x4001, 0xBFFF), -1); // ends one byte short of the wrapped match
+    EXPECT_EQ(mem.find_pattern(pattern, sizeof(pattern), 0x4001, 0xC001), 0xFFFE);
+    EXPECT_EQ(mem.find_pattern(pattern, 2, 0x0000), 0x0100);
+}
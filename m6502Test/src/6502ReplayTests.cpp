@@ -0,0 +1,196 @@
+﻿#include "6502Replay.h"
+#include "6502StateHash.h"
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+
+using namespace m6502;
+
+// a device that can't be reproduced: its answers depend on its own random state and on the cycle
+class NoisyDevice : public InputSource
+{
+public:
+    std::mt19937 random{ 2024 };
+    uint8_t read(uint16_t address, uint64_t cycle) override
+    {
+        if (address == 0xD000)
+        {
+            return random() % 4 == 0 ? random() & 0xFF : 0;
+        }
+        return cycle & 0xFF;
+    }
+};
+
+class m6502ReplayTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPU cpu;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+    }
+
+    // polls $D000 and logs what it reads to $0300, the IRQ handler counts into $10 and acks by reading $D001
+    void LoadPollingProgram(CPU& cpu, Mem& memory)
+    {
+        const uint8_t program[] = {
+            0xA2, 0x00,             // 8000: LDX #$00
+            0xAD, 0x00, 0xD0,       // 8002: LDA $D000
+            0xF0, 0xFB,             // 8005: BEQ $8002
+            0x9D, 0x00, 0x03,       // 8007: STA $0300,X
+            0xE8,                   // 800A: INX
+            0x58,                   // 800B: CLI
+            0x4C, 0x02, 0x80,       // 800C: JMP $8002
+        };
+        const uint8_t handlers[] = {
+            0xE6, 0x10,             // 9000: INC $10
+            0xAD, 0x01, 0xD0,       // 9002: LDA $D001
+            0x85, 0x11,             // 9005: STA $11
+            0x40,                   // 9007: RTI
+        };
+        for (size_t i = 0; i < sizeof(program); i++)
+        {
+            memory[0x8000 + i] = program[i];
+        }
+        for (size_t i = 0; i < sizeof(handlers); i++)
+        {
+            memory[0x9000 + i] = handlers[i];
+        }
+        memory[0x9100] = 0xE6; // NMI: INC $12
+        memory[0x9101] = 0x12;
+        memory[0x9102] = 0x40; // RTI
+        memory[0xFFFA] = 0x00;
+        memory[0xFFFB] = 0x91;
+        memory[0xFFFE] = 0x00;
+        memory[0xFFFF] = 0x90;
+        memory.mark_all_dirty();
+        cpu.PC = 0x8000;
+        cpu.inputPages[0xD0] = true;
+    }
+};
+
+TEST_F(m6502ReplayTest, ReplayReproducesTheRecordedRun)
+{
+    // given:
+    NoisyDevice device;
+    std::stringstream log;
+    InputRecorder recorder(device, log);
+    LoadPollingProgram(cpu, mem);
+    cpu.inputSource = &recorder;
+
+    std::mt19937 host(7);
+    for (int slice = 0; slice < 2000; slice++)
+    {
+        cpu.execute(1 + host() % 500, mem);
+        if (host() % 10 == 0)
+        {
+            recorder.irq(cpu, mem);
+        }
+        if (host() % 50 == 0)
+        {
+            recorder.nmi(cpu, mem);
+        }
+    }
+    StateHash recorded;
+    recorded.update(cpu, mem);
+
+    Mem replayMem;
+    CPU replayCpu;
+    replayCpu.reset(replayMem);
+    LoadPollingProgram(replayCpu, replayMem);
+    InputPlayer player(log);
+    replayCpu.inputSource = &player;
+
+    // when:
+    while (replayCpu.cycleCount < cpu.cycleCount)
+    {
+        player.run(replayCpu, replayMem, std::min<uint64_t>(777, cpu.cycleCount - replayCpu.cycleCount));
+    }
+
+    // then:
+    StateHash replayed;
+    replayed.update(replayCpu, replayMem);
+    EXPECT_EQ(StateHash::first_difference(recorded, replayed), StateHash::NO_DIFFERENCE);
+    EXPECT_EQ(replayCpu.cycleCount, cpu.cycleCount);
+    EXPECT_TRUE(player.finished());
+    EXPECT_GT(mem[0x10], 0);
+    EXPECT_GT(mem[0x12], 0);
+    EXPECT_GT(recorder.events(), 1000u);
+    EXPECT_LT(recorder.bytes(), 4 * recorder.events());
+}
+
+TEST_F(m6502ReplayTest, ReplayDetectsDivergence)
+{
+    // given:
+    NoisyDevice device;
+    std::stringstream log;
+    InputRecorder recorder(device, log);
+    LoadPollingProgram(cpu, mem);
+    cpu.inputSource = &recorder;
+    cpu.execute(2000, mem);
+
+    Mem replayMem;
+    CPU replayCpu;
+    replayCpu.reset(replayMem);
+    LoadPollingProgram(replayCpu, replayMem);
+    replayMem[0x8000] = 0xEA; // NOP, shifts every read by a cycle
+    replayMem[0x8001] = 0xEA;
+    InputPlayer player(log);
+    replayCpu.inputSource = &player;
+
+    // then:
+    EXPECT_THROW(player.run(replayCpu, replayMem, 2000), std::runtime_error);
+}
+
+TEST_F(m6502ReplayTest, EventsAreDeltaAndVarintEncoded)
+{
+    // given:
+    NoisyDevice device;
+    std::stringstream log;
+    InputRecorder recorder(device, log);
+
+    // when:
+    uint8_t first = recorder.read(0xD001, 5);
+    uint8_t second = recorder.read(0xD001, 9);
+    uint8_t third = recorder.read(0xD000, 10);
+    cpu.cycleCount = 300;
+    recorder.irq(cpu, mem);
+
+    // then:
+    const std::string expected = std::string("65RL\x01", 5)
+        + "\x14\xFD\xBF\x01" + char(first)    // 5 cycles, +$D001 (as -$2FFF)
+        + '\x10' + '\x00' + char(second)      // 4 cycles, same address
+        + "\x04\x01" + char(third)            // 1 cycle, -1
+        + "\x89\x09";                         // IRQ 290 cycles later
+    EXPECT_EQ(log.str(), expected);
+    EXPECT_EQ(recorder.bytes(), expected.size());
+
+    InputPlayer player(log);
+    EXPECT_EQ(player.read(0xD001, 5), first);
+    EXPECT_EQ(player.read(0xD001, 9), second);
+    EXPECT_THROW(player.read(0xD001, 10), std::runtime_error);
+}
+
+TEST_F(m6502ReplayTest, ARecordingCutShortReplaysUpToItsLastCompleteEvent)
+{
+    // given: three reads, the last one missing its value
+    NoisyDevice device;
+    std::stringstream log;
+    InputRecorder recorder(device, log);
+    uint8_t first = recorder.read(0xD001, 5);
+    uint8_t second = recorder.read(0xD001, 9);
+    recorder.read(0xD000, 10);
+    std::string recording = log.str();
+    std::istringstream truncated(recording.substr(0, recording.size() - 1));
+
+    // when:
+    InputPlayer player(truncated);
+
+    // then:
+    EXPECT_EQ(player.read(0xD001, 5), first);
+    EXPECT_EQ(player.read(0xD001, 9), second);
+    EXPECT_TRUE(player.finished());
+    EXPECT_TRUE(player.cut_short());
+}
@@ -0,0 +1,202 @@
+﻿#include "RunJob.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using namespace m6502;
+
+class m6502RunJobTest : public testing::Test
+{
+public:
+    RunJob job;
+    std::vector<std::filesystem::path> images;
+
+    virtual void TearDown() override
+    {
+        for (const std::filesystem::path& image : images)
+        {
+            std::filesystem::remove(image);
+        }
+    }
+
+    // writes a raw image to a temporary file and adds it to the job at address
+    void AddImage(const std::vector<uint8_t>& bytes, uint16_t address)
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path()
+            / ("m6502RunJobTest_" + std::to_string(images.size()) + "_" + std::to_string((uintptr_t)this) + ".bin");
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        images.push_back(path);
+        job.images.push_back({path.string(), address});
+    }
+};
+
+TEST_F(m6502RunJobTest, ParseJobArgsReadsImagesAndOptions)
+{
+    // when:
+    std::string error = parse_job_args({"rom.bin@$C000", "--cpu", "65c02", "--reset", "0xC000", "--trap", "$C010",
+                                        "--trap", "49168", "--exit", "$0200", "--halt-on-brk", "--max-cycles", "5000"}, job);
+
+    // then:
+    EXPECT_EQ(error, "");
+    ASSERT_EQ(job.images.size(), 1u);
+    EXPECT_EQ(job.images[0].path, "rom.bin");
+    EXPECT_EQ(job.images[0].address, 0xC000);
+    EXPECT_EQ(job.name, "rom.bin@$C000");
+    EXPECT_EQ(job.cpu, "65c02");
+    EXPECT_EQ(job.resetVector, 0xC000);
+    EXPECT_EQ(job.traps, (std::vector<uint16_t>{0xC010, 0xC010}));
+    EXPECT_EQ(job.exitAddress, 0x0200);
+    EXPECT_TRUE(job.haltOnBrk);
+    EXPECT_EQ(job.maxCycles, 5000);
+}
+
+TEST_F(m6502RunJobTest, ParseJobArgsRejectsBadArguments)
+{
+    RunJob scratch;
+    EXPECT_EQ(parse_job_args({"--bogus"}, scratch), "unknown option --bogus");
+    EXPECT_EQ(parse_job_args({"--trap"}, scratch), "--trap needs a value");
+    EXPECT_EQ(parse_job_args({"--cpu", "z80"}, scratch), "unknown cpu z80");
+    EXPECT_EQ(parse_job_args({"--reset", "0x10000"}, scratch), "bad address for --reset: 0x10000");
+    EXPECT_EQ(parse_job_args({"--exit", "12ab"}, scratch), "bad address for --exit: 12ab");
+    EXPECT_EQ(parse_job_args({"--max-cycles", "-5"}, scratch), "bad cycle count -5");
+    EXPECT_EQ(parse_job_args({"rom.bin@$1G00"}, scratch), "bad load address in rom.bin@$1G00");
+}
+
+TEST_F(m6502RunJobTest, ImagesThatDoNotFitOrDoNotExistFail)
+{
+    // given:
+    AddImage({0xEA, 0xEA, 0xEA, 0xEA}, 0xFFFE);
+
+    // when:
+    RunResult result = run_job(job);
+    job.images = {{"/nonexistent/m6502RunJobTest.bin", 0}};
+    RunResult missing = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::Error);
+    EXPECT_NE(result.error.find("does not fit at $FFFE"), std::string::npos) << result.error;
+    EXPECT_EQ(missing.reason, StopReason::Error);
+    EXPECT_EQ(missing.error, "cannot open /nonexistent/m6502RunJobTest.bin");
+}
+
+TEST_F(m6502RunJobTest, AnyWriteToTheExitPortEndsTheJob)
+{
+    // given: writing $FF, which is also what the port held before
+    AddImage({0xA9, 0xFF,           // 8000: LDA #$FF
+              0x8D, 0x00, 0x02,     // 8002: STA $0200
+              0x4C, 0x05, 0x80},    // 8005: JMP $8005
+             0x8000);
+    AddImage({0xFF}, 0x0200);
+    job.resetVector = 0x8000;
+    job.exitAddress = 0x0200;
+
+    // when:
+    RunResult result = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::Exit);
+    EXPECT_EQ(result.exitCode, 0xFF);
+    EXPECT_EQ(result.PC, 0x8005); // right after the store
+    EXPECT_EQ(result.cycles, 6);
+    EXPECT_EQ(result.instructions, 2);
+}
+
+TEST_F(m6502RunJobTest, OtherWritesToTheExitPortsPageDoNotEndTheJob)
+{
+    // given:
+    AddImage({0x8D, 0x01, 0x02,     // 8000: STA $0201
+              0x8D, 0x00, 0x02},    // 8003: STA $0200
+             0x8000);
+    job.resetVector = 0x8000;
+    job.exitAddress = 0x0200;
+
+    // when:
+    RunResult result = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::Exit);
+    EXPECT_EQ(result.exitCode, 0x00);
+    EXPECT_EQ(result.PC, 0x8006);
+    EXPECT_EQ(result.instructions, 2);
+}
+
+TEST_F(m6502RunJobTest, AProgramParkedOnATrapStops)
+{
+    // given:
+    AddImage({0xE8,                 // 8000: INX
+              0x4C, 0x01, 0x80},    // 8001: JMP $8001
+             0x8000);
+    job.resetVector = 0x8000;
+    job.traps = {0x8001};
+
+    // when:
+    RunResult result = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::Trap);
+    EXPECT_EQ(result.PC, 0x8001);
+    EXPECT_EQ(result.cycles, 2);
+}
+
+TEST_F(m6502RunJobTest, ATrapIsCaughtWhenTheProgramOnlyPassesThrough)
+{
+    // given:
+    AddImage({0xEA,                 // 0600: NOP
+              0xEA,                 // 0601: NOP
+              0x4C, 0x00, 0x06},    // 0602: JMP $0600
+             0x0600);
+    job.resetVector = 0x0600;
+    job.traps = {0x0601};
+
+    // when:
+    RunResult result = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::Trap);
+    EXPECT_EQ(result.PC, 0x0601);
+    EXPECT_EQ(result.cycles, 2);
+    EXPECT_EQ(result.instructions, 1);
+}
+
+TEST_F(m6502RunJobTest, HaltOnBrkStopsBeforeTheBRKAndChecksTrapsEveryInstruction)
+{
+    // given:
+    AddImage({0xE8,                 // 8000: INX
+              0xE8,                 // 8001: INX
+              0x00},                // 8002: BRK
+             0x8000);
+    job.resetVector = 0x8000;
+    job.haltOnBrk = true;
+
+    // when:
+    RunResult brk = run_job(job);
+    job.traps = {0x8001};
+    RunResult trap = run_job(job);
+
+    // then:
+    EXPECT_EQ(brk.reason, StopReason::Brk);
+    EXPECT_EQ(brk.PC, 0x8002);
+    EXPECT_EQ(brk.cycles, 4);
+    EXPECT_EQ(brk.instructions, 2);
+    EXPECT_EQ(trap.reason, StopReason::Trap);
+    EXPECT_EQ(trap.PC, 0x8001);
+    EXPECT_EQ(trap.cycles, 2);
+}
+
+TEST_F(m6502RunJobTest, JobsWithoutAHaltStopAtTheCycleLimit)
+{
+    // given:
+    AddImage({0x4C, 0x00, 0x80}, 0x8000); // 8000: JMP $8000
+    job.resetVector = 0x8000;
+    job.maxCycles = 3000;
+
+    // when:
+    RunResult result = run_job(job);
+
+    // then:
+    EXPECT_EQ(result.reason, StopReason::CycleLimit);
+    EXPECT_EQ(result.cycles, 3000);
+    EXPECT_EQ(result.instructions, 1000);
+}
@@ -0,0 +1,185 @@
+﻿#include "6502SharedMem.h"
+#include "6502StateHash.h"
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace m6502;
+
+class m6502SharedMemTest : public testing::Test
+{
+public:
+    SharedMem shared;
+    CPU cpu;
+    std::array<uint8_t, Mem::MEM_SIZE> image;
+    virtual void SetUp() override
+    {
+        cpu.reset(shared.mem());
+        image.fill(0xFF);
+    }
+
+    // opens the export the way an external monitor would
+    int OpenFromOutside()
+    {
+        std::string path = "/proc/self/fd/" + std::to_string(shared.fd());
+        return open(path.c_str(), O_RDONLY);
+    }
+};
+
+TEST_F(m6502SharedMemTest, ReadersSeeTheCPUsWritesAfterPublish)
+{
+    // given:
+    int fd = OpenFromOutside();
+    ASSERT_GE(fd, 0);
+    SharedMemReader reader(fd);
+    close(fd); // the mapping stays valid
+    shared.publish();
+    EXPECT_EQ(reader.update(image).copiedPages, SharedMemHeader::PAGE_COUNT); // everything the first time
+    Mem& mem = shared.mem();
+    const uint8_t program[] = {0xA9, 0x37, 0x8D, 0x80, 0x44}; // LDA #$37, STA $4480
+    mem.load_block(0xFFFC, program, sizeof(program)); // wraps to $0000 and marks the pages
+
+    // when:
+    shared.begin_update();
+    cpu.execute(6, mem);
+    size_t changedPages = shared.publish();
+
+    // then:
+    EXPECT_EQ(changedPages, 3u); // 0x00, 0x44 and 0xFF
+    SharedMemReader::UpdateResult result = reader.update(image);
+    EXPECT_FALSE(result.busy);
+    EXPECT_EQ(result.copiedPages, 3u);
+    EXPECT_EQ(image[0x4480], 0x37);
+    EXPECT_EQ(image[0xFFFC], 0xA9);
+    EXPECT_EQ(reader.generation(), shared.generation());
+}
+
+TEST_F(m6502SharedMemTest, NothingIsCopiedWhenNothingChanged)
+{
+    // given:
+    SharedMemReader reader(shared.fd());
+    shared.publish();
+    reader.update(image);
+
+    // when:
+    size_t changedPages = shared.publish();
+
+    // then:
+    EXPECT_EQ(changedPages, 0u);
+    EXPECT_EQ(reader.update(image).copiedPages, 0u);
+}
+
+TEST_F(m6502SharedMemTest, PublishAndAStateHashBothSeeEveryWrite)
+{
+    // given:
+    SharedMemReader reader(shared.fd());
+    StateHash hash;
+    Mem& mem = shared.mem();
+    shared.publish();
+    reader.update(image);
+    hash.update(cpu, mem);
+
+    for (bool hashFirst : { true, false })
+    {
+        // when:
+        shared.begin_update();
+        mem.fill(hashFirst ? 0x4400 : 0x5500, 0x37, 1);
+        size_t changedPages = 0;
+        if (hashFirst)
+        {
+            hash.update(cpu, mem);
+            changedPages = shared.publish();
+        }
+        else
+        {
+            changedPages = shared.publish();
+            hash.update(cpu, mem);
+        }
+
+        // then:
+        EXPECT_EQ(changedPages, 1u) << hashFirst;
+        EXPECT_EQ(hash.rehashed_pages(), 1u) << hashFirst;
+        EXPECT_EQ(reader.update(image).copiedPages, 1u) << hashFirst;
+        StateHash fresh;
+        EXPECT_EQ(hash.root(), fresh.update(cpu, mem)) << hashFirst;
+    }
+    EXPECT_EQ(image[0x4400], 0x37);
+    EXPECT_EQ(image[0x5500], 0x37);
+}
+
+TEST_F(m6502SharedMemTest, ReaderGivesUpOnAWriterStuckMidUpdate)
+{
+    // given:
+    SharedMemReader reader(shared.fd());
+    shared.mem().fill(0x4400, 0x37, 1);
+    shared.publish();
+    reader.update(image);
+    uint64_t generation = reader.generation();
+
+    // when:
+    shared.begin_update(); // and the writer never publishes
+    shared.mem().fill(0x4400, 0x42, 1);
+    SharedMemReader::UpdateResult result = reader.update(image, 4);
+
+    // then:
+    EXPECT_TRUE(result.busy);
+    EXPECT_EQ(result.copiedPages, 0u);
+    EXPECT_EQ(image[0x4400], 0x37);
+    EXPECT_EQ(reader.generation(), generation);
+}
+
+TEST_F(m6502SharedMemTest, ConcurrentReadersNeverSeeATornImage)
+{
+    // given: a writer filling pages $10-$2F with the same value, which changes on every update
+    SharedMemReader reader(shared.fd());
+    std::atomic<bool> done = false;
+    std::thread writer([&]() {
+        for (uint32_t value = 0; !done; value++)
+        {
+            shared.begin_update();
+            shared.mem().fill(0x1000, (uint8_t)value, 0x2000);
+            shared.publish();
+        }
+    });
+
+    // when:
+    int consistentReads = 0, tornReads = 0;
+    for (int read = 0; read < 2000; read++)
+    {
+        if (reader.update(image).busy)
+        {
+            continue;
+        }
+        consistentReads++;
+        if (std::count(image.begin() + 0x1000, image.begin() + 0x3000, image[0x1000]) != 0x2000)
+        {
+            tornReads++;
+        }
+    }
+    done = true;
+    writer.join();
+
+    // then:
+    EXPECT_GT(consistentReads, 0);
+    EXPECT_EQ(tornReads, 0);
+}
+
+TEST_F(m6502SharedMemTest, ReaderRejectsOtherFiles)
+{
+    int fd = memfd_create("not-an-export", 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, SharedMemHeader::IMAGE_OFFSET + Mem::MEM_SIZE), 0);
+
+    EXPECT_THROW(SharedMemReader reader(fd), std::runtime_error);
+    close(fd);
+}
+
+#endif
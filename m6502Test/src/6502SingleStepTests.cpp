@@ -0,0 +1,153 @@
+﻿#include "6502SingleStep.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <sstream>
+
+using namespace m6502;
+
+class m6502SingleStepTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPU cpu;
+    SingleStepCase testCase;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+    }
+
+    bool MemoryIsClear() const
+    {
+        return std::all_of(mem.mem.begin(), mem.mem.end(), [](uint8_t byte) { return byte == 0; });
+    }
+};
+
+// LDA #$5B, then STA $10 with an extra key and a field order the reader has to cope with
+static const char* TWO_CASES = R"([
+    {
+        "name": "a9 5b 1c",
+        "initial": { "pc": 4660, "s": 253, "a": 0, "x": 1, "y": 2, "p": 38, "ram": [ [4660, 169], [4661, 91] ] },
+        "final": { "pc": 4662, "s": 253, "a": 91, "x": 1, "y": 2, "p": 36, "ram": [ [4660, 169], [4661, 91] ] },
+        "cycles": [ [4660, 169, "read"], [4661, 91, "read"] ]
+    },
+    {
+        "comment": { "nested": [1, 2.5, -3, true, null, "x\"y"] },
+        "cycles": [ [512, 133, "read"], [513, 16, "read"], [16, 119, "write"] ],
+        "name": "85 10 00",
+        "initial": { "ram": [ [512, 133], [513, 16] ], "pc": 512, "s": 255, "a": 119, "x": 0, "y": 0, "p": 48 },
+        "final": { "pc": 514, "s": 255, "a": 119, "x": 0, "y": 0, "p": 48, "ram": [ [512, 133], [513, 16], [16, 119] ] }
+    }
+])";
+
+TEST_F(m6502SingleStepTest, ReaderStreamsOneCaseAtATime)
+{
+    // given:
+    std::istringstream input(TWO_CASES);
+    SingleStepReader reader(input);
+
+    // when:
+    ASSERT_TRUE(reader.next(testCase));
+
+    // then:
+    EXPECT_EQ(testCase.name, "a9 5b 1c");
+    EXPECT_EQ(testCase.initial.PC, 0x1234);
+    EXPECT_EQ(testCase.initial.SP, 0xFD);
+    EXPECT_EQ(testCase.initial.P, 0x26);
+    EXPECT_EQ(testCase.expected.A, 0x5B);
+    EXPECT_EQ(testCase.expected.ram.size(), 2u);
+    EXPECT_EQ(testCase.cycles, 2u);
+
+    // when:
+    ASSERT_TRUE(reader.next(testCase));
+
+    // then:
+    EXPECT_EQ(testCase.name, "85 10 00");
+    EXPECT_EQ(testCase.initial.ram.size(), 2u);
+    EXPECT_EQ(testCase.expected.ram[2], (std::pair<uint16_t, uint8_t>(0x10, 0x77)));
+    EXPECT_EQ(testCase.cycles, 3u);
+    EXPECT_FALSE(reader.next(testCase));
+    EXPECT_FALSE(reader.next(testCase));
+}
+
+TEST_F(m6502SingleStepTest, AStateWithoutRamHasNone)
+{
+    // given:
+    std::istringstream input(R"([
+        { "name": "a", "initial": { "pc": 1, "ram": [ [1, 234] ] }, "final": { "pc": 2, "ram": [ [1, 234] ] } },
+        { "name": "b", "initial": { "pc": 1 }, "final": { "pc": 2 } }
+    ])");
+    SingleStepReader reader(input);
+    ASSERT_TRUE(reader.next(testCase));
+
+    // when:
+    ASSERT_TRUE(reader.next(testCase));
+
+    // then:
+    EXPECT_EQ(testCase.name, "b");
+    EXPECT_TRUE(testCase.initial.ram.empty());
+    EXPECT_TRUE(testCase.expected.ram.empty());
+}
+
+TEST_F(m6502SingleStepTest, PassingCasesLeaveMemoryClear)
+{
+    // given:
+    std::istringstream input(TWO_CASES);
+    SingleStepReader reader(input);
+
+    while (reader.next(testCase))
+    {
+        // when:
+        std::string mismatches = run_single_step(testCase, cpu, mem);
+
+        // then:
+        EXPECT_EQ(mismatches, "") << testCase.name;
+        EXPECT_TRUE(MemoryIsClear()) << testCase.name;
+    }
+}
+
+TEST_F(m6502SingleStepTest, MismatchesAreDescribed)
+{
+    // given:
+    std::istringstream input(TWO_CASES);
+    SingleStepReader reader(input);
+    reader.next(testCase);
+    reader.next(testCase);
+    testCase.expected.ram[2].second = 0x78;
+    testCase.expected.X = 5;
+    testCase.cycles = 4;
+
+    // when:
+    std::string mismatches = run_single_step(testCase, cpu, mem);
+
+    // then:
+    EXPECT_EQ(mismatches, "X $0 expected $5; [$10] $77 expected $78; cycles 3 expected 4; ");
+    EXPECT_TRUE(MemoryIsClear());
+}
+
+TEST_F(m6502SingleStepTest, WritesTheCaseDoesNotListAreReportedAndCleared)
+{
+    // given: the STA $10 case, without the write in the final RAM
+    std::istringstream input(TWO_CASES);
+    SingleStepReader reader(input);
+    reader.next(testCase);
+    reader.next(testCase);
+    testCase.expected.ram.pop_back();
+
+    // when:
+    std::string mismatches = run_single_step(testCase, cpu, mem);
+
+    // then:
+    EXPECT_EQ(mismatches, "stray write [$10] $77; ");
+    EXPECT_TRUE(MemoryIsClear());
+}
+
+TEST_F(m6502SingleStepTest, MalformedInputThrows)
+{
+    // given:
+    std::istringstream input(R"([ { "name": "a9", "initial": { "pc": -1 } } ])");
+    SingleStepReader reader(input);
+
+    // then:
+    EXPECT_THROW(reader.next(testCase), std::runtime_error);
+}
@@ -0,0 +1,129 @@
+﻿#include "6502StateHash.h"
+#include <gtest/gtest.h>
+
+using namespace m6502;
+
+class m6502StateHashTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPU cpu;
+    StateHash hash;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+    }
+
+    // fills $1200-$12FF with X, counting down from $FF, then spins
+    void LoadFillProgram(Mem& memory)
+    {
+        const uint8_t program[] = {
+            0xA2, 0xFF,             // 8000: LDX #$FF
+            0x8A,                   // 8002: TXA
+            0x9D, 0x00, 0x12,       // 8003: STA $1200,X
+            0xCA,                   // 8006: DEX
+            0xD0, 0xF9,             // 8007: BNE $8002
+            0x4C, 0x09, 0x80,       // 8009: JMP $8009
+        };
+        for (size_t i = 0; i < sizeof(program); i++)
+        {
+            memory[0x8000 + i] = program[i];
+        }
+        memory[0xFFFC] = 0x4C; // JMP $8000
+        memory[0xFFFD] = 0x00;
+        memory[0xFFFE] = 0x80;
+    }
+};
+
+TEST_F(m6502StateHashTest, IncrementalHashMatchesAFullRehash)
+{
+    // given:
+    LoadFillProgram(mem);
+    hash.update(cpu, mem);
+
+    for (int slice = 0; slice < 50; slice++)
+    {
+        // when:
+        cpu.execute(97, mem);
+        uint64_t incremental = hash.update(cpu, mem);
+
+        // then:
+        StateHash fresh;
+        EXPECT_EQ(incremental, fresh.update(cpu, mem)) << "slice " << slice;
+    }
+    EXPECT_EQ(mem[0x1201], 0x01);
+}
+
+TEST_F(m6502StateHashTest, OnlyDirtyPagesAreRehashed)
+{
+    // given:
+    LoadFillProgram(mem);
+    hash.update(cpu, mem);
+    EXPECT_EQ(hash.rehashed_pages(), Mem::PAGE_COUNT);
+    cpu.execute(200, mem);
+
+    // when:
+    uint64_t root = hash.update(cpu, mem);
+
+    // then:
+    EXPECT_EQ(hash.rehashed_pages(), 1u); // $12xx
+    EXPECT_FALSE(mem.is_dirty(0x12));
+    EXPECT_EQ(hash.update(cpu, mem), root);
+    EXPECT_EQ(hash.rehashed_pages(), 0u);
+}
+
+TEST_F(m6502StateHashTest, RewritingTheSameValueKeepsTheHash)
+{
+    // given:
+    mem[0x3456] = 0x42;
+    uint64_t root = hash.update(cpu, mem);
+
+    // when:
+    mem[0x3456] = 0x42;
+    mem.mark_dirty(0x3456);
+
+    // then:
+    EXPECT_EQ(hash.update(cpu, mem), root);
+    EXPECT_EQ(hash.rehashed_pages(), 1u);
+}
+
+TEST_F(m6502StateHashTest, FirstDifferenceFindsTheLowestDifferingPage)
+{
+    // given:
+    Mem otherMem;
+    CPU otherCpu;
+    otherCpu.reset(otherMem);
+    StateHash other;
+    hash.update(cpu, mem);
+    other.update(otherCpu, otherMem);
+    EXPECT_EQ(StateHash::first_difference(hash, other), StateHash::NO_DIFFERENCE);
+
+    // when:
+    otherCpu.A = 1;
+    other.update(otherCpu, otherMem);
+
+    // then:
+    EXPECT_EQ(StateHash::first_difference(hash, other), StateHash::REGISTERS_DIFFER);
+
+    // when:
+    otherMem[0xC0DE] = 1;
+    otherMem.mark_dirty(0xC0DE);
+    otherMem[0x7001] = 1;
+    otherMem.mark_dirty(0x7001);
+    other.update(otherCpu, otherMem);
+
+    // then:
+    EXPECT_EQ(StateHash::first_difference(hash, other), 0x70);
+    EXPECT_EQ(StateHash::first_difference(other, hash), 0x70);
+}
+
+TEST_F(m6502StateHashTest, EqualPagesAtDifferentAddressesHashDifferently)
+{
+    // given:
+    uint8_t page[Mem::PAGE_SIZE] = {};
+
+    // then:
+    EXPECT_NE(hash_page(page, 0), hash_page(page, 1));
+    page[255] = 1;
+    EXPECT_NE(hash_page(page, 0), hash_page(mem.mem.data(), 0));
+}
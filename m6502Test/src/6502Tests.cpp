@@ -67,6 +67,84 @@ TEST_F( m6502Test1, CPUCanExecuteMoreCyclesThanRequestedIfRequiredByTheInstructi
     EXPECT_EQ(cyclesUsed, 2);
 }
 
+TEST_F( m6502Test1, ExecuteUntilStopsBeforeTheInstructionAtWhichTheConditionHolds)
+{
+    // given:
+    mem[0xFFFC] = CPU::INS_LDA_IM;
+    mem[0xFFFD] = 0x84;
+    mem[0xFFFE] = CPU::INS_LDX_IM;
+    mem[0xFFFF] = 0x37;
+    int32_t instructions = 0;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute_until(100, mem, [&](const CPU& cpu, const Mem&) {
+        return cpu.PC == 0xFFFE || ++instructions > 100;
+    });
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 2);
+    EXPECT_EQ(instructions, 1);
+    EXPECT_EQ(cpu.A, 0x84);
+    EXPECT_EQ(cpu.X, 0x00);
+}
+
+TEST_F( m6502Test1, IRQPushesPCAndStatusAndJumpsThroughTheVectorUnlessMasked)
+{
+    // given:
+    cpu.PC = 0x1234;
+    cpu.C = 1;
+    cpu.I = 1;
+    mem[0xFFFE] = 0x00;
+    mem[0xFFFF] = 0x90;
+
+    // when:
+    bool takenWhileMasked = cpu.irq(mem);
+    cpu.I = 0;
+    bool taken = cpu.irq(mem);
+
+    // then:
+    EXPECT_FALSE(takenWhileMasked);
+    EXPECT_TRUE(taken);
+    EXPECT_EQ(cpu.PC, 0x9000);
+    EXPECT_EQ(cpu.SP, 0xFC);
+    EXPECT_EQ(mem[0x01FF], 0x12);
+    EXPECT_EQ(mem[0x01FE], 0x34);
+    EXPECT_EQ(mem[0x01FD], 0x21); // C and the unused bit, B clear
+    EXPECT_TRUE(cpu.I);
+    EXPECT_EQ(cpu.cycleCount, 7u);
+}
+
+TEST_F( m6502Test1, NMICannotBeMasked)
+{
+    // given:
+    cpu.PC = 0x1234;
+    cpu.I = 1;
+    mem[0xFFFA] = 0x00;
+    mem[0xFFFB] = 0x91;
+
+    // when:
+    cpu.nmi(mem);
+
+    // then:
+    EXPECT_EQ(cpu.PC, 0x9100);
+    EXPECT_EQ(mem[0x01FD], 0x24);
+}
+
+TEST_F( m6502Test1, CycleCountAddsUpEveryExecute)
+{
+    // given:
+    mem[0xFFFC] = 0x4C; // JMP $FFFC
+    mem[0xFFFD] = 0xFC;
+    mem[0xFFFE] = 0xFF;
+
+    // when:
+    cpu.execute(4, mem);
+    cpu.execute(1, mem);
+
+    // then:
+    EXPECT_EQ(cpu.cycleCount, 9u);
+}
+
 void m6502Test1::TestLoadRegisterImmediate(uint8_t opcode, uint8_t CPU::*RegisterToTest) // pointer to a member variable. ugly syntax but worth it
 {
     // given:
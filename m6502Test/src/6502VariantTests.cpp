@@ -0,0 +1,341 @@
+﻿#include "6502.h"
+#include <gtest/gtest.h>
+
+using namespace m6502;
+
+// one fixture per CPU variant, all sharing the same memory setup
+template <typename CPUType>
+class m6502VariantTest : public testing::Test
+{
+public:
+    Mem mem;
+    CPUType cpu;
+    virtual void SetUp() override
+    {
+        cpu.reset(mem);
+    }
+};
+
+using m6502NMOSTest = m6502VariantTest<CPU>;
+using m6502IllegalTest = m6502VariantTest<CPUIllegal>;
+using m6502CMOSTest = m6502VariantTest<CPU65C02>;
+
+TEST_F(m6502NMOSTest, UndocumentedOpcodesAreSingleByteNOPs)
+{
+    // given:
+    mem[0xFFFC] = 0xA7; // LAX zp on the NMOS
+    mem[0xFFFD] = 0x42;
+    mem[0x0042] = 0x37;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(2, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 2);
+    EXPECT_EQ(cpu.PC, 0xFFFD);
+    EXPECT_EQ(cpu.A, 0x00);
+    EXPECT_EQ(cpu.X, 0x00);
+}
+
+TEST_F(m6502NMOSTest, JSRAndRTSReturnToTheNextInstruction)
+{
+    // given:
+    mem[0xFFFC] = CPU::INS_JSR;
+    mem[0xFFFD] = 0x00;
+    mem[0xFFFE] = 0x80;
+    mem[0x8000] = 0x60; // RTS
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(12, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 12);
+    EXPECT_EQ(cpu.PC, 0xFFFF);
+    EXPECT_EQ(cpu.SP, 0xFF);
+    EXPECT_EQ(mem[0x01FF], 0xFF); // return address - 1, high byte first
+    EXPECT_EQ(mem[0x01FE], 0xFE);
+}
+
+TEST_F(m6502NMOSTest, JMPIndirectDoesNotCarryIntoThePointerHighByte)
+{
+    // given:
+    mem[0xFFFC] = 0x6C;
+    mem[0xFFFD] = 0xFF;
+    mem[0xFFFE] = 0x10; // JMP ($10FF)
+    mem[0x10FF] = 0x34;
+    mem[0x1000] = 0x12;
+    mem[0x1100] = 0x56;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(5, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 5);
+    EXPECT_EQ(cpu.PC, 0x1234);
+}
+
+TEST_F(m6502NMOSTest, ADCInDecimalModeAddsBCD)
+{
+    // given:
+    cpu.D = 1;
+    cpu.A = 0x09;
+    mem[0xFFFC] = 0x69; // ADC #$01
+    mem[0xFFFD] = 0x01;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(2, mem);
+
+    // then:
+    EXPECT_EQ(cpu.A, 0x10);
+    EXPECT_EQ(cyclesUsed, 2);
+    EXPECT_FALSE(cpu.C);
+}
+
+TEST_F(m6502NMOSTest, SBCInDecimalModeBorrowsBCD)
+{
+    // given:
+    cpu.D = 1;
+    cpu.C = 1;
+    cpu.A = 0x10;
+    mem[0xFFFC] = 0xE9; // SBC #$01
+    mem[0xFFFD] = 0x01;
+
+    // when:
+    cpu.execute(2, mem);
+
+    // then:
+    EXPECT_EQ(cpu.A, 0x09);
+    EXPECT_TRUE(cpu.C);
+}
+
+TEST_F(m6502IllegalTest, LAXLoadsAAndX)
+{
+    // given:
+    mem[0xFFFC] = 0xA7; // LAX zp
+    mem[0xFFFD] = 0x42;
+    mem[0x0042] = 0x84;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(3, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 3);
+    EXPECT_EQ(cpu.A, 0x84);
+    EXPECT_EQ(cpu.X, 0x84);
+    EXPECT_TRUE(cpu.N);
+    EXPECT_FALSE(cpu.Z);
+}
+
+TEST_F(m6502IllegalTest, SAXStoresAAndX)
+{
+    // given:
+    cpu.A = 0xF0;
+    cpu.X = 0x3C;
+    mem[0xFFFC] = 0x87; // SAX zp
+    mem[0xFFFD] = 0x42;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(3, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 3);
+    EXPECT_EQ(mem[0x0042], 0x30);
+}
+
+TEST_F(m6502IllegalTest, DCPDecrementsMemoryAndCompares)
+{
+    // given:
+    cpu.A = 0x10;
+    mem[0xFFFC] = 0xCF; // DCP abs
+    mem[0xFFFD] = 0x00;
+    mem[0xFFFE] = 0x44;
+    mem[0x4400] = 0x11;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(6, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 6);
+    EXPECT_EQ(mem[0x4400], 0x10);
+    EXPECT_TRUE(cpu.Z);
+    EXPECT_TRUE(cpu.C);
+}
+
+TEST_F(m6502IllegalTest, InterruptsDoNotRestartAJammedCPU)
+{
+    // given:
+    mem[0xFFFC] = 0x02; // JAM
+    mem[0xFFFA] = 0x00;
+    mem[0xFFFB] = 0x90;
+    cpu.execute(10, mem);
+
+    // when:
+    cpu.nmi(mem);
+    cpu.execute(10, mem);
+
+    // then:
+    EXPECT_TRUE(cpu.is_stopped());
+    EXPECT_EQ(cpu.PC, 0xFFFC);
+    EXPECT_EQ(cpu.SP, 0xFF);
+}
+
+TEST_F(m6502CMOSTest, BRAAlwaysBranches)
+{
+    // given:
+    mem[0xFFFC] = 0x80; // BRA -4
+    mem[0xFFFD] = 0xFC;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(3, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 3);
+    EXPECT_EQ(cpu.PC, 0xFFFA);
+}
+
+TEST_F(m6502CMOSTest, WAIAndSTPTakeThreeCycles)
+{
+    // given:
+    mem[0xFFFC] = 0xCB; // WAI
+    mem[0xFFF0] = 0xDB; // STP
+
+    // when:
+    int32_t waiCycles = cpu.execute(1, mem);
+    cpu.PC = 0xFFF0;
+    int32_t stpCycles = cpu.execute(1, mem);
+
+    // then:
+    EXPECT_EQ(waiCycles, 3);
+    EXPECT_EQ(stpCycles, 3);
+    EXPECT_EQ(cpu.PC, 0xFFF0);
+}
+
+TEST_F(m6502CMOSTest, InterruptsDoNotRestartAStoppedCPU)
+{
+    // given:
+    mem[0xFFF0] = 0xDB; // STP
+    mem[0xFFFE] = 0x00;
+    mem[0xFFFF] = 0x90;
+    mem[0xFFFA] = 0x00;
+    mem[0xFFFB] = 0x90;
+    cpu.PC = 0xFFF0;
+    cpu.execute(10, mem);
+
+    // when:
+    bool taken = cpu.irq(mem);
+    cpu.nmi(mem);
+
+    // then:
+    EXPECT_FALSE(taken);
+    EXPECT_TRUE(cpu.is_stopped());
+    EXPECT_EQ(cpu.PC, 0xFFF0);
+    EXPECT_EQ(cpu.SP, 0xFF);
+
+    // when:
+    cpu.reset(mem);
+
+    // then:
+    EXPECT_FALSE(cpu.is_stopped());
+}
+
+TEST_F(m6502CMOSTest, AnInterruptWakesUpWAIAndReturnsPastIt)
+{
+    // given:
+    mem[0xFFF0] = 0xCB; // WAI
+    mem[0xFFFE] = 0x00;
+    mem[0xFFFF] = 0x90;
+    cpu.PC = 0xFFF0;
+    cpu.execute(10, mem);
+    EXPECT_EQ(cpu.PC, 0xFFF0);
+
+    // when:
+    cpu.irq(mem);
+
+    // then:
+    EXPECT_EQ(cpu.PC, 0x9000);
+    EXPECT_EQ(mem[0x01FF], 0xFF);
+    EXPECT_EQ(mem[0x01FE], 0xF1);
+}
+
+TEST_F(m6502CMOSTest, STZStoresZero)
+{
+    // given:
+    mem[0xFFFC] = 0x9C; // STZ abs
+    mem[0xFFFD] = 0x80;
+    mem[0xFFFE] = 0x44;
+    mem[0x4480] = 0x37;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(4, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 4);
+    EXPECT_EQ(mem[0x4480], 0x00);
+}
+
+TEST_F(m6502CMOSTest, PHXAndPLYMoveXToYThroughTheStack)
+{
+    // given:
+    cpu.X = 0x80;
+    mem[0xFFFC] = 0xDA; // PHX
+    mem[0xFFFD] = 0x7A; // PLY
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(7, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 7);
+    EXPECT_EQ(cpu.Y, 0x80);
+    EXPECT_EQ(cpu.SP, 0xFF);
+    EXPECT_TRUE(cpu.N);
+}
+
+TEST_F(m6502CMOSTest, JMPIndirectCrossesThePointerPage)
+{
+    // given:
+    mem[0xFFFC] = 0x6C;
+    mem[0xFFFD] = 0xFF;
+    mem[0xFFFE] = 0x10; // JMP ($10FF)
+    mem[0x10FF] = 0x34;
+    mem[0x1000] = 0x12;
+    mem[0x1100] = 0x56;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(6, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 6);
+    EXPECT_EQ(cpu.PC, 0x5634);
+}
+
+TEST_F(m6502CMOSTest, ADCInDecimalModeTakesAnExtraCycleAndSetsValidFlags)
+{
+    // given:
+    cpu.D = 1;
+    cpu.A = 0x99;
+    mem[0xFFFC] = 0x69; // ADC #$01
+    mem[0xFFFD] = 0x01;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(3, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 3);
+    EXPECT_EQ(cpu.A, 0x00);
+    EXPECT_TRUE(cpu.C);
+    EXPECT_TRUE(cpu.Z);
+    EXPECT_FALSE(cpu.N);
+}
+
+TEST_F(m6502CMOSTest, UnusedOpcodesAreSingleCycleNOPs)
+{
+    // given:
+    mem[0xFFFC] = 0x03;
+
+    // when:
+    int32_t cyclesUsed = cpu.execute(1, mem);
+
+    // then:
+    EXPECT_EQ(cyclesUsed, 1);
+    EXPECT_EQ(cpu.PC, 0xFFFD);
+}